@@ -0,0 +1,50 @@
+/*
+ * allocators.c - The table of malloc packages linked into the driver
+ */
+#include <string.h>
+
+#include "allocators.h"
+
+/* Declare the interface of the package whose names start with p_ */
+#define DECLARE_PACKAGE(p)                                      \
+    extern int p##_init(void);                                  \
+    extern void *p##_malloc(size_t size);                       \
+    extern void p##_free(void *ptr);                            \
+    extern void *p##_realloc(void *ptr, size_t size);           \
+    extern void *p##_calloc(size_t nmemb, size_t size);         \
+    extern void p##_checkheap(int lineno);                      \
+    extern size_t p##_usable_size(void *ptr);                   \
+    extern size_t p##_free_bytes(void);                         \
+    extern int p##_setparam(const char *name, const char *value); \
+    extern void p##_stats(struct mm_stats_t *stats);            \
+    extern void p##_heap_walk(void (*fn)(size_t, size_t, int, void *), \
+                              void *arg)
+
+#define PACKAGE(name, p)                                        \
+    { name, p##_init, p##_malloc, p##_free, p##_realloc,        \
+      p##_calloc, p##_checkheap, p##_usable_size,               \
+      p##_free_bytes, p##_setparam, p##_stats, p##_heap_walk }
+
+DECLARE_PACKAGE(mm);
+DECLARE_PACKAGE(textbook);
+DECLARE_PACKAGE(naive);
+
+const allocator_t allocators[] = {
+    PACKAGE("mm", mm),
+    PACKAGE("textbook", textbook),
+    PACKAGE("naive", naive),
+    { NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL }
+};
+
+/*
+ * find_allocator - Look a package up by name
+ */
+const allocator_t *find_allocator(const char *name)
+{
+    const allocator_t *a;
+
+    for (a = allocators; a->name != NULL; a++)
+        if (strcmp(a->name, name) == 0)
+            return a;
+    return NULL;
+}
@@ -0,0 +1,32 @@
+/*
+ * allocators.h - The malloc packages linked into the driver
+ *
+ * mm.c keeps the mm_ names; the other packages are compiled with their
+ * names prefixed (textbook_malloc, naive_malloc, ...; see the Makefile),
+ * so all of them can be linked into one driver and picked at run time.
+ */
+#include <stddef.h>
+
+struct mm_stats_t;  /* see mm.h */
+
+typedef struct {
+    const char *name;
+    int (*init)(void);
+    void *(*malloc)(size_t size);
+    void (*free)(void *ptr);
+    void *(*realloc)(void *ptr, size_t size);
+    void *(*calloc)(size_t nmemb, size_t size);
+    void (*checkheap)(int lineno);
+    size_t (*usable_size)(void *ptr);
+    size_t (*free_bytes)(void);
+    int (*setparam)(const char *name, const char *value);
+    void (*stats)(struct mm_stats_t *stats);
+    void (*heap_walk)(void (*fn)(size_t offset, size_t size, int alloc,
+                                 void *arg), void *arg);
+} allocator_t;
+
+/* All the packages, mm.c first; the list ends with a NULL name */
+extern const allocator_t allocators[];
+
+/* The package called name, or NULL if there is none */
+extern const allocator_t *find_allocator(const char *name);
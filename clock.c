@@ -10,9 +10,26 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <time.h>
 #include <sys/times.h>
 #include "clock.h"
 
+#if defined(__i386__) || defined(__x86_64__)
+#include <cpuid.h>
+#endif
+
+/* How long mhz() measures the counter when its rate isn't reported */
+#define CALIBRATE_MSECS 250
+
+/* Nanoseconds on the raw (not NTP-slewed) monotonic clock */
+static double monotonic_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
 
 /******************************************************* 
  * Machine dependent functions 
@@ -33,21 +50,48 @@
 static unsigned cyc_hi = 0;
 static unsigned cyc_lo = 0;
 
+/* Which time source the counter reads: -1 undecided, 1 TSC, 0 clock_gettime */
+static int use_tsc = -1;
+static double start_ns = 0.0;
+
 
 /* Set *hi and *lo to the high and low order bits  of the cycle counter.  
-   Implementation requires assembly code to use the rdtsc instruction. */
+   Implementation requires assembly code to use the rdtsc instruction.
+   The lfence keeps earlier instructions from drifting past the read. */
 void access_counter(unsigned *hi, unsigned *lo)
 {
-    asm("rdtsc; movl %%edx,%0; movl %%eax,%1"   /* Read cycle counter */
-        : "=r" (*hi), "=r" (*lo)                /* and move results to */
-        : /* No input */                        /* the two outputs */
-        : "%edx", "%eax");
+    asm volatile("lfence; rdtsc; movl %%edx,%0; movl %%eax,%1" /* Read cycle counter */
+                 : "=r" (*hi), "=r" (*lo)                     /* and move results to */
+                 : /* No input */                             /* the two outputs */
+                 : "%edx", "%eax", "memory");
+}
+
+/* Is the TSC invariant, i.e. does it tick at a constant rate across
+   frequency changes and sleep states? (CPUID 0x80000007, EDX bit 8) */
+static int tsc_invariant(void)
+{
+    unsigned eax, ebx, ecx, edx;
+
+    if (!__get_cpuid(0x80000000, &eax, &ebx, &ecx, &edx) || eax < 0x80000007)
+        return 0;
+    __get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx);
+    return (edx >> 8) & 1;
+}
+
+static void init_counter(void)
+{
+    if (use_tsc < 0)
+        use_tsc = tsc_invariant();
 }
 
 /* Record the current value of the cycle counter. */
 void start_counter()
 {
-    access_counter(&cyc_hi, &cyc_lo);
+    init_counter();
+    if (use_tsc)
+        access_counter(&cyc_hi, &cyc_lo);
+    else
+        start_ns = monotonic_ns();
 }
 
 /* Return the number of cycles since the last call to start_counter. */
@@ -57,6 +101,9 @@ double get_counter()
     unsigned hi, lo, borrow;
     double result;
 
+    if (!use_tsc)
+        return monotonic_ns() - start_ns;
+
     /* Get cycle counter */
     access_counter(&ncyc_hi, &ncyc_lo);
 
@@ -72,6 +119,110 @@ double get_counter()
 }
 /* $end x86cyclecounter */
 
+/* Read the TSC as a single 64-bit value */
+static unsigned long long read_tsc(void)
+{
+    unsigned hi, lo;
+
+    access_counter(&hi, &lo);
+    return ((unsigned long long)hi << 32) | lo;
+}
+
+/* Read the counter as one 64-bit value. The fences on both sides keep
+   the code being timed from moving across the read in either direction. */
+unsigned long long read_counter(void)
+{
+    unsigned hi, lo;
+
+    init_counter();
+    if (!use_tsc)
+        return (unsigned long long)monotonic_ns();
+    asm volatile("lfence; rdtsc; lfence" : "=a" (lo), "=d" (hi) : : "memory");
+    return ((unsigned long long)hi << 32) | lo;
+}
+
+/* TSC rate in MHz as reported by the kernel or the CPU, or 0 if unknown */
+static double tsc_mhz_reported(void)
+{
+    FILE *fp;
+    unsigned long khz = 0;
+    unsigned eax, ebx, ecx, edx;
+
+    /* Some kernels export the rate they calibrated at boot */
+    if ((fp = fopen("/sys/devices/system/cpu/cpu0/tsc_freq_khz", "r")) != NULL) {
+        if (fscanf(fp, "%lu", &khz) != 1)
+            khz = 0;
+        fclose(fp);
+        if (khz > 0)
+            return khz / 1e3;
+    }
+
+    /* CPUID 0x15: TSC = crystal clock (ECX Hz) * EBX / EAX */
+    if (__get_cpuid_max(0, NULL) >= 0x15) {
+        __cpuid(0x15, eax, ebx, ecx, edx);
+        if (eax != 0 && ebx != 0 && ecx != 0)
+            return (double)ecx * ebx / eax / 1e6;
+    }
+    return 0.0;
+}
+
+/* Take a (TSC, ns) pair, retrying until both reads land close together */
+static void tsc_sample(unsigned long long *tsc, double *ns)
+{
+    unsigned long long t0, t1, best = ~0ULL;
+    double now;
+    int i;
+
+    for (i = 0; i < 10; i++) {
+        t0 = read_tsc();
+        now = monotonic_ns();
+        t1 = read_tsc();
+        if (i == 0 || t1 - t0 < best) {
+            best = t1 - t0;
+            *tsc = t0 + (t1 - t0) / 2;
+            *ns = now;
+        }
+    }
+}
+
+/* Measure the TSC rate in MHz against CLOCK_MONOTONIC_RAW */
+static double tsc_mhz_calibrate(int msecs)
+{
+    unsigned long long tsc0, tsc1;
+    double ns0, ns1;
+    struct timespec req;
+
+    req.tv_sec = msecs / 1000;
+    req.tv_nsec = (msecs % 1000) * 1000000L;
+    tsc_sample(&tsc0, &ns0);
+    nanosleep(&req, NULL);
+    tsc_sample(&tsc1, &ns1);
+    return (tsc1 - tsc0) / (ns1 - ns0) * 1e3;
+}
+
+/* Rate of the counter behind start_counter()/get_counter() in MHz */
+static double counter_mhz(int verbose, int msecs)
+{
+    double rate;
+
+    init_counter();
+    if (!use_tsc) {
+        if (verbose)
+            printf("TSC is not invariant, timing with clock_gettime()\n");
+        return 1e3; /* the counter counts nanoseconds */
+    }
+
+    if ((rate = tsc_mhz_reported()) > 0) {
+        if (verbose)
+            printf("Processor clock rate ~= %.1f MHz (reported)\n", rate);
+    } else {
+        rate = tsc_mhz_calibrate(msecs);
+        if (verbose)
+            printf("Processor clock rate ~= %.1f MHz (calibrated)\n", rate);
+    }
+    return rate;
+}
+
 #elif defined(__alpha)
 
 /****************************************************
@@ -134,6 +285,26 @@ double get_counter()
     return result;
 }
 
+unsigned long long read_counter(void)
+{
+    return counter();
+}
+
+/* Measure the clock rate by counting cycles over msecs of real time */
+static double counter_mhz(int verbose, int msecs)
+{
+    double ns0, rate;
+
+    ns0 = monotonic_ns();
+    start_counter();
+    while (monotonic_ns() - ns0 < msecs * 1e6)
+        ;
+    rate = get_counter() / ((monotonic_ns() - ns0) / 1e3);
+    if (verbose)
+        printf("Processor clock rate ~= %.1f MHz\n", rate);
+    return rate;
+}
+
 #else
 
 /****************************************************************
@@ -141,23 +312,32 @@ double get_counter()
  * counter routines. Newer models of sparcs (v8plus) have cycle
  * counters that can be accessed from user programs, but since there
  * are still many sparc boxes out there that don't support this, we
- * haven't provided a Sparc version here.
+ * haven't provided a Sparc version here. The counter counts
+ * nanoseconds of CLOCK_MONOTONIC_RAW instead.
  ***************************************************************/
 
+static double start_ns = 0.0;
+
 void start_counter()
 {
-    printf("ERROR: You are trying to use a start_counter routine in clock.c\n");
-    printf("that has not been implemented yet on this platform.\n");
-    printf("Please choose another timing package in config.h.\n");
-    exit(1);
+    start_ns = monotonic_ns();
 }
 
 double get_counter() 
 {
-    printf("ERROR: You are trying to use a get_counter routine in clock.c\n");
-    printf("that has not been implemented yet on this platform.\n");
-    printf("Please choose another timing package in config.h.\n");
-    exit(1);
+    return monotonic_ns() - start_ns;
+}
+
+unsigned long long read_counter(void)
+{
+    return (unsigned long long)monotonic_ns();
+}
+
+static double counter_mhz(int verbose, int msecs __attribute__((unused)))
+{
+    if (verbose)
+        printf("No cycle counter, timing with clock_gettime()\n");
+    return 1e3;
 }
 #endif
 
@@ -181,44 +361,22 @@ double ovhd()
 }
 
 /* $begin mhz */
-/* Get the clock rate from /proc */
-double mhz_full(int verbose, int sleeptime __attribute__((unused)))
+/* Determine the rate of the counter, measuring for sleeptime secs
+   if neither the kernel nor the CPU reports it */
+double mhz_full(int verbose, int sleeptime)
 {
-    static char buf[2048];
-
-    FILE *fp = fopen("/proc/cpuinfo", "r");
-    double mhz = 0.0;
-
-    while (fgets(buf, 2048, fp)) {
-        if (strstr(buf, "cpu MHz")) {
-            sscanf(buf, "cpu MHz\t: %lf", &mhz);
-            break;
-        }
-    }
-    fclose(fp);
-    /* Get mhz from vm could be different, so set it static */
-    mhz = 2000;
-    if (verbose) 
-        printf("Processor clock rate ~= %.1f MHz\n", mhz);
-    return mhz;
-
-#if 0
-    double rate;
-
-    start_counter();
-    sleep(sleeptime);
-    rate = get_counter() / (1e6*sleeptime);
-    if (verbose) 
-        printf("Processor clock rate ~= %.1f MHz\n", rate);
-    return rate;
-#endif
+    return counter_mhz(verbose, sleeptime * 1000);
 }
 /* $end mhz */
 
-/* Version using a default sleeptime */
+/* Version using a default calibration time; measured once and remembered */
 double mhz(int verbose)
 {
-    return mhz_full(verbose, 2);
+    static double rate = 0.0;
+
+    if (rate == 0.0)
+        rate = counter_mhz(verbose, CALIBRATE_MSECS);
+    return rate;
 }
 
 /** Special counters that compensate for timer interrupt overhead */
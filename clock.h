@@ -6,6 +6,9 @@ void start_counter();
 /* Get # cycles since counter started */
 double get_counter();
 
+/* Read the raw counter, serialized against the surrounding code */
+unsigned long long read_counter(void);
+
 /* Measure overhead for counter */
 double ovhd();
 
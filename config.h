@@ -108,6 +108,15 @@
  */
 #define MAX_HEAP (100*(1<<20))  /* 100 MB */
 
+/*
+ * When comparing against a baseline report (mdriver -b), a trace counts
+ * as slower only if even its best sample is this fraction slower than
+ * the worst of the baseline's K best samples. Utilization is
+ * deterministic, so any drop larger than BASELINE_UTIL_TOL counts.
+ */
+#define BASELINE_TOL      0.05
+#define BASELINE_UTIL_TOL 0.001
+
 /*****************************************************************************
  * Set exactly one of these USE_xxx constants to "1" to select a timing method
  *****************************************************************************/
@@ -0,0 +1,170 @@
+/*
+ * evdump.c - Decode the binary request logs written by evlog.c
+ *
+ * Prints one line per record, or with -s a summary of the log:
+ *
+ *     unix> ./mdriver -E bash.evlog -f traces/bash.rep
+ *     unix> ./evdump bash.evlog | head
+ *     unix> ./evdump -s bash.evlog
+ *
+ * Times are printed relative to the first clock reading, in the ticks
+ * the header names (TSC cycles or nanoseconds). Each record gets the
+ * reading of the EV_TIME record before it, which isn't printed.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+
+#include "evlog.h"
+
+#define NCLASSES 256  /* the class field is a byte */
+
+static const char *opnames[] = { "init", "malloc", "free", "realloc", "lost" };
+
+static void usage(void)
+{
+    fprintf(stderr, "Usage: evdump [-hs] <log>\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-h         Print this message.\n");
+    fprintf(stderr, "\t-s         Print a summary instead of every record.\n");
+}
+
+/*
+ * print_offset - An offset, or "-" for NULL
+ */
+static void print_offset(uint32_t offset)
+{
+    if (offset == EV_NOOFFSET)
+        printf(" %10s", "-");
+    else
+        printf(" %10u", offset);
+}
+
+/*
+ * print_class - A class, or what stands in for one
+ */
+static void print_class(int class)
+{
+    if (class == EV_HEAP)
+        printf(" %5s", "heap");
+    else if (class == EV_NOCLASS)
+        printf(" %5s", "-");
+    else
+        printf(" %5d", class);
+}
+
+int main(int argc, char **argv)
+{
+    int c, k;
+    int summary = 0;
+    FILE *fp;
+    evhdr_t hdr;
+    evrec_t r;
+    uint64_t time = 0, first = 0, last = 0, nrecs = 0;
+    int timed = 0;
+    unsigned long count[EV_LOST + 1] = { 0 };
+    unsigned long served[NCLASSES] = { 0 };
+    unsigned long lost = 0, searches = 0, nodes = 0, long_searches = 0;
+    unsigned max_search = 0;
+
+    while ((c = getopt(argc, argv, "hs")) != EOF) {
+        switch (c) {
+        case 's':
+            summary = 1;
+            break;
+        case 'h':
+            usage();
+            exit(0);
+        default:
+            usage();
+            exit(1);
+        }
+    }
+    if (optind != argc - 1) {
+        usage();
+        exit(1);
+    }
+
+    if ((fp = fopen(argv[optind], "rb")) == NULL) {
+        fprintf(stderr, "evdump: cannot open %s\n", argv[optind]);
+        exit(1);
+    }
+    if (fread(&hdr, sizeof(hdr), 1, fp) != 1 ||
+        memcmp(hdr.magic, EV_MAGIC, sizeof(EV_MAGIC)) != 0) {
+        fprintf(stderr, "evdump: %s is not an event log\n", argv[optind]);
+        exit(1);
+    }
+    if (hdr.version != EV_VERSION || hdr.recsize != sizeof(evrec_t)) {
+        fprintf(stderr, "evdump: %s has version %u with %u-byte records; "
+                "we read version %d with %zu-byte records\n", argv[optind],
+                hdr.version, hdr.recsize, EV_VERSION, sizeof(evrec_t));
+        exit(1);
+    }
+
+    if (!summary)
+        printf("%14s %-7s %10s %10s %10s %5s %6s\n", "time", "op", "offset",
+               "size", "old", "class", "search");
+    while (fread(&r, sizeof(r), 1, fp) == 1) {
+        if (r.op > EV_TIME) {
+            fprintf(stderr, "evdump: bad record %lu\n", (unsigned long)nrecs);
+            exit(1);
+        }
+        if (r.op == EV_TIME) {
+            time = (uint64_t)r.old_offset << 32 | r.offset;
+            if (!timed)
+                first = time;
+            timed = 1;
+            last = time;
+            continue;
+        }
+        nrecs++;
+        count[r.op]++;
+        if (r.op == EV_LOST)
+            lost += r.size;
+        if ((r.op == EV_MALLOC || r.op == EV_REALLOC) && r.offset != EV_NOOFFSET) {
+            served[r.class]++;
+            searches++;
+            nodes += r.search;
+            if (r.search > max_search)
+                max_search = r.search;
+            if (r.search > 16)
+                long_searches++;
+        }
+        if (summary)
+            continue;
+
+        printf("%14llu %-7s", (unsigned long long)(time - first),
+               opnames[r.op]);
+        print_offset(r.offset);
+        printf(" %10u", r.size);
+        print_offset(r.old_offset);
+        print_class(r.class);
+        printf(" %6u\n", r.search);
+    }
+    fclose(fp);
+
+    if (!summary)
+        return 0;
+    printf("records      %lu over %llu %s\n", (unsigned long)nrecs,
+           (unsigned long long)(last - first),
+           hdr.clock == EV_CLOCK_TSC ? "cycles" : "ns");
+    for (k = 0; k <= EV_LOST; k++)
+        printf("%-12s %lu\n", opnames[k], count[k]);
+    printf("dropped      %lu\n", lost);
+    printf("search       mean %.2f, max %u, over 16 in %.2f%% of requests\n",
+           searches ? (double)nodes / searches : 0.0, max_search,
+           searches ? 100.0 * long_searches / searches : 0.0);
+    printf("served by   ");
+    for (k = 0; k < NCLASSES; k++) {
+        if (served[k] == 0)
+            continue;
+        if (k == EV_HEAP)
+            printf(" heap:%lu", served[k]);
+        else
+            printf(" %d:%lu", k, served[k]);
+    }
+    printf("\n");
+    return 0;
+}
@@ -0,0 +1,270 @@
+/*
+ * evlog.c - Binary log of the requests the mm package serves
+ *
+ * The allocator appends fixed-size records to a ring buffer in memory,
+ * and a thread of our own writes them to the file behind it, so the
+ * allocator never waits for I/O. The ring has a single producer (the
+ * allocator) and a single consumer (the flusher); they share only the
+ * head and tail counters. When the flusher falls a full ring behind,
+ * records are dropped rather than stall the allocator, and an EV_LOST
+ * record says how many.
+ *
+ * A request to mm.c takes a few tens of nanoseconds, and reading the
+ * TSC can take as long again (more under a hypervisor), so the clock
+ * is read every EV_TICK requests, into an EV_TIME record that dates
+ * the ones after it; records hold no time of their own, which keeps
+ * them to 16 bytes. The allocator also keeps its own copy of the tail
+ * and only reads the flusher's when the ring looks full. Between
+ * readings of the clock, with room in the ring, a record is just
+ * stores, which EVLOG_PUT inlines into the allocator; evlog_put()
+ * does everything else and sets how far that can go on.
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "evlog.h"
+#include "memlib.h"
+
+int evlog_on = 0;
+
+evrec_t evlog_ring[EV_RING];
+uint64_t evlog_head;        /* the allocator's */
+uint64_t evlog_limit;
+char *evlog_heap_lo;
+
+static uint64_t tail;       /* records written out so far (the flusher's) */
+static uint64_t lost;       /* records dropped since the last one put */
+static uint64_t tail_seen;  /* the allocator's last look at tail */
+static int fd = -1;
+static int stopping;        /* tells the flusher to drain and quit */
+static int write_error;     /* errno of the first failed write */
+static pthread_t flusher;
+
+/*
+ * now - A cheap timestamp: the TSC without fences where there is one
+ */
+static uint64_t now(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+/*
+ * write_all - write(2) all of buf, or record why not
+ */
+static void write_all(const void *buf, size_t len)
+{
+    ssize_t n;
+
+    while (len > 0 && write_error == 0) {
+        if ((n = write(fd, buf, len)) < 0) {
+            if (errno != EINTR)
+                write_error = errno;
+            continue;
+        }
+        buf = (const char *)buf + n;
+        len -= n;
+    }
+}
+
+/*
+ * flush_loop - The flusher: write out the records between tail and
+ *     head, and nap for a millisecond when there are none
+ */
+static void *flush_loop(void *arg)
+{
+    struct timespec nap = { 0, 1000000 };
+    uint64_t h, n;
+    int stop;
+
+    for (;;) {
+        /* Read stopping before head, so a final batch isn't missed */
+        stop = __atomic_load_n(&stopping, __ATOMIC_ACQUIRE);
+        h = __atomic_load_n(&evlog_head, __ATOMIC_ACQUIRE);
+        if (h == tail) {
+            if (stop)
+                break;
+            nanosleep(&nap, NULL);
+            continue;
+        }
+        /* Up to the end of the ring; the rest goes next time round */
+        n = h - tail;
+        if (n > EV_RING - tail % EV_RING)
+            n = EV_RING - tail % EV_RING;
+        write_all(&evlog_ring[tail % EV_RING], n * sizeof(evrec_t));
+        __atomic_store_n(&tail, tail + n, __ATOMIC_RELEASE);
+    }
+    return arg;
+}
+
+/*
+ * evlog_open - Create the log file and start the flusher
+ */
+const char *evlog_open(const char *path)
+{
+    evhdr_t hdr;
+
+    if (fd >= 0)
+        return "a log is already open";
+    if ((fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0)
+        return strerror(errno);
+
+    memset(&hdr, 0, sizeof(hdr));
+    strcpy(hdr.magic, EV_MAGIC);
+    hdr.version = EV_VERSION;
+    hdr.recsize = sizeof(evrec_t);
+#if defined(__x86_64__) || defined(__i386__)
+    hdr.clock = EV_CLOCK_TSC;
+#else
+    hdr.clock = EV_CLOCK_NS;
+#endif
+    evlog_head = evlog_limit = tail = lost = tail_seen = 0;
+    evlog_heap_lo = mem_heap_lo();
+    stopping = write_error = 0;
+    write_all(&hdr, sizeof(hdr));
+    if (write_error != 0 || pthread_create(&flusher, NULL, flush_loop, NULL)) {
+        close(fd);
+        fd = -1;
+        return write_error ? strerror(write_error) : "cannot start the flusher";
+    }
+    evlog_on = 1;
+    return NULL;
+}
+
+/*
+ * evlog_exit, evlog_child - Close the log at exit; and in a child made
+ *     by fork(), which has no flusher, stop logging to it
+ */
+static void evlog_exit(void)
+{
+    evlog_close();
+}
+
+static void evlog_child(void)
+{
+    if (fd < 0)
+        return;
+    evlog_on = 0;
+    evlog_limit = 0;
+    close(fd);
+    fd = -1;
+}
+
+/*
+ * evlog_init - Start logging to the file MM_EVLOG names, in a process
+ *     running on libmm.so. Its heap is set up by then, so the EV_INIT
+ *     record is written here.
+ */
+void evlog_init(void)
+{
+    static int registered = 0;
+    const char *s = getenv("MM_EVLOG");
+
+    if (fd >= 0 || s == NULL || *s == '\0' || evlog_open(s) != NULL)
+        return;
+    evlog_put(EV_INIT, mem_heapsize(), NULL, NULL, EV_NOCLASS, 0);
+    if (!registered) {
+        atexit(evlog_exit);
+        pthread_atfork(NULL, NULL, evlog_child);
+        registered = 1;
+    }
+}
+
+/*
+ * fill - Fill in the record at position h of the ring
+ */
+static void fill(uint64_t h, int op, size_t size, const void *p,
+                 const void *oldp, int class, unsigned search)
+{
+    evrec_t *r = &evlog_ring[h % EV_RING];
+
+    r->offset = p ? (uint32_t)((char *)p - evlog_heap_lo) : EV_NOOFFSET;
+    r->old_offset = oldp ? (uint32_t)((char *)oldp - evlog_heap_lo) : EV_NOOFFSET;
+    r->size = size;
+    r->op = op;
+    r->class = class;
+    r->search = search > 0xffff ? 0xffff : search;
+}
+
+/*
+ * fill_time - Read the clock into an EV_TIME record at position h
+ */
+static void fill_time(uint64_t h)
+{
+    evrec_t *r = &evlog_ring[h % EV_RING];
+    uint64_t t = now();
+
+    r->offset = (uint32_t)t;
+    r->old_offset = (uint32_t)(t >> 32);
+    r->size = 0;
+    r->op = EV_TIME;
+    r->class = EV_NOCLASS;
+    r->search = 0;
+}
+
+/*
+ * evlog_put - Append a clock reading and a record, if there is room in
+ *     the ring, and set evlog_limit for the records after them
+ */
+void evlog_put(int op, size_t size, const void *p, const void *oldp,
+               int class, unsigned search)
+{
+    uint64_t h = evlog_head;
+    int need = 2 + (lost > 0);  /* EV_TIME, any EV_LOST, the record */
+
+    evlog_limit = 0;
+    if (op == EV_INIT)
+        evlog_heap_lo = mem_heap_lo();
+    if (h - tail_seen + need > EV_RING) {
+        tail_seen = __atomic_load_n(&tail, __ATOMIC_ACQUIRE);
+        if (h - tail_seen + need > EV_RING) {
+            lost++;
+            return;
+        }
+    }
+    fill_time(h++);
+    if (lost > 0) {
+        fill(h++, EV_LOST, lost, NULL, NULL, EV_NOCLASS, 0);
+        lost = 0;
+    }
+    fill(h++, op, size, p, oldp, class, search);
+    __atomic_store_n(&evlog_head, h, __ATOMIC_RELEASE);
+
+    /* Up to the next reading of the clock, or a full ring */
+    evlog_limit = h + EV_TICK - 1;
+    if (evlog_limit > tail_seen + EV_RING)
+        evlog_limit = tail_seen + EV_RING;
+}
+
+/*
+ * evlog_close - Stop logging, let the flusher drain the ring, and close
+ *     the file
+ */
+const char *evlog_close(void)
+{
+    if (fd < 0)
+        return NULL;
+    evlog_on = 0;
+    evlog_limit = 0;
+    __atomic_store_n(&stopping, 1, __ATOMIC_RELEASE);
+    pthread_join(flusher, NULL);
+    if (lost > 0) {
+        fill(evlog_head, EV_LOST, lost, NULL, NULL, EV_NOCLASS, 0);
+        write_all(&evlog_ring[evlog_head % EV_RING], sizeof(evrec_t));
+    }
+    if (close(fd) < 0 && write_error == 0)
+        write_error = errno;
+    fd = -1;
+    return write_error ? strerror(write_error) : NULL;
+}
@@ -0,0 +1,93 @@
+/*
+ * evlog.h - Binary log of the requests the mm package serves
+ *
+ * A log file is an evhdr_t followed by fixed-size evrec_t records,
+ * one per malloc, free or realloc, in the order they were served.
+ * The clock is only read every so many records, and its reading goes
+ * in an EV_TIME record of its own, which holds for the records after
+ * it.
+ */
+#include <stddef.h>
+#include <stdint.h>
+
+/* Record types */
+enum { EV_INIT, EV_MALLOC, EV_FREE, EV_REALLOC, EV_LOST, EV_TIME };
+
+#define EV_HEAP     0xff        /* class of a request served by a new chunk */
+#define EV_NOCLASS  0xfe        /* class when there is none (failed, NULL) */
+#define EV_NOOFFSET 0xffffffffU /* offset of a NULL pointer */
+
+typedef struct {
+    uint32_t offset;     /* payload offset from the start of the heap;
+                            EV_TIME: low half of the clock reading */
+    uint32_t old_offset; /* the block realloc moved, or EV_NOOFFSET;
+                            EV_TIME: high half of the clock reading */
+    uint32_t size;       /* bytes asked for; EV_INIT: heap size, EV_LOST:
+                            number of records dropped */
+    uint8_t op;          /* one of the record types */
+    uint8_t class;       /* free list that served a malloc or realloc, or
+                            that got the (coalesced) block of a free */
+    uint16_t search;     /* free blocks find_fit looked at, up to 65535 */
+} evrec_t;
+
+#define EV_MAGIC "MMEVLOG"
+#define EV_VERSION 2     /* 1 had a clock reading in every record */
+enum { EV_CLOCK_TSC, EV_CLOCK_NS };
+
+typedef struct {
+    char magic[8];       /* EV_MAGIC */
+    uint32_t version;    /* EV_VERSION */
+    uint32_t recsize;    /* sizeof(evrec_t) */
+    uint32_t clock;      /* what EV_TIME readings count */
+    uint32_t unused;
+} evhdr_t;
+
+/* Nonzero while requests are being logged; the mm package checks it */
+extern int evlog_on;
+
+/* Start logging to path; NULL on success, or what went wrong */
+extern const char *evlog_open(const char *path);
+
+/* Start logging to the file MM_EVLOG names, if it is set, until exit */
+extern void evlog_init(void);
+
+/* Log one request. p and oldp are payload pointers (NULL is fine). */
+extern void evlog_put(int op, size_t size, const void *p, const void *oldp,
+                      int class, unsigned search);
+
+/*
+ * The ring, for EVLOG_PUT. Records below evlog_limit can go straight
+ * in: there is room for them, no drop is waiting to be reported, and
+ * the clock isn't due to be read. The rest go through evlog_put().
+ */
+#define EV_RING (1 << 16)   /* records in the ring; a power of two */
+#define EV_TICK 128         /* requests per reading of the clock */
+
+extern evrec_t evlog_ring[EV_RING];
+extern uint64_t evlog_head;     /* records put so far */
+extern uint64_t evlog_limit;    /* see above */
+extern char *evlog_heap_lo;     /* start of the heap, from the last EV_INIT */
+
+/* evlog_put(), with the common case inlined */
+#define EVLOG_PUT(op_, size_, p_, oldp_, class_, search_) do {           \
+        if (evlog_head < evlog_limit) {                                  \
+            evrec_t *r_ = &evlog_ring[evlog_head % EV_RING];             \
+            const char *p__ = (const char *)(p_);                        \
+            const char *oldp__ = (const char *)(oldp_);                  \
+            unsigned search__ = (search_);                               \
+            r_->offset = p__ ? (uint32_t)(p__ - evlog_heap_lo)           \
+                             : EV_NOOFFSET;                              \
+            r_->old_offset = oldp__ ? (uint32_t)(oldp__ - evlog_heap_lo) \
+                                    : EV_NOOFFSET;                       \
+            r_->size = (size_);                                          \
+            r_->op = (op_);                                              \
+            r_->class = (class_);                                        \
+            r_->search = search__ > 0xffff ? 0xffff : search__;          \
+            __atomic_store_n(&evlog_head, evlog_head + 1,                \
+                             __ATOMIC_RELEASE);                          \
+        } else                                                           \
+            evlog_put(op_, size_, p_, oldp_, class_, search_);           \
+    } while (0)
+
+/* Stop logging and write out whatever is left; NULL or an error */
+extern const char *evlog_close(void);
@@ -36,6 +36,10 @@ static int *cache_buf = NULL;
 static double *values = NULL;
 static int samplecount = 0;
 
+/* the K best values of the most recent measurement */
+static double *last_values = NULL;
+static int last_count = 0;
+
 /* for debugging only */
 #define KEEP_VALS 0
 #define KEEP_SAMPLES 0
@@ -160,6 +164,18 @@ double fcyc(test_funct f, void *argp)
     }
 #endif
     result = values[0];
+
+    /* remember the K best for get_fcyc_kbest() */
+    free(last_values);
+    last_count = samplecount < kbest ? samplecount : kbest;
+    last_values = calloc(kbest, sizeof(double));
+    if (last_values) {
+	int i;
+	for (i = 0; i < last_count; i++)
+	    last_values[i] = values[i];
+    } else {
+	last_count = 0;
+    }
 #if !KEEP_VALS
     free(values); 
     values = NULL;
@@ -168,6 +184,21 @@ double fcyc(test_funct f, void *argp)
 }
 
 
+/*
+ * get_fcyc_kbest - Copy up to max of the K best values of the most
+ *     recent fcyc() call into vals, smallest first. Returns the number
+ *     of values copied.
+ */
+int get_fcyc_kbest(double *vals, int max)
+{
+    int i;
+
+    for (i = 0; i < last_count && i < max; i++)
+	vals[i] = last_values[i];
+    return i;
+}
+
+
 /*************************************************************
  * Set the various parameters used by the measurement routines 
  ************************************************************/
@@ -13,6 +13,10 @@ typedef void (*test_funct)(void *);
 /* Compute number of cycles used by test function f */
 double fcyc(test_funct f, void* argp);
 
+/* Copy up to max of the K best samples of the last fcyc() call into
+   vals, smallest first; returns how many were copied */
+int get_fcyc_kbest(double *vals, int max);
+
 /*********************************************************
  * Set the various parameters used by measurement routines 
  *********************************************************/
@@ -9,6 +9,9 @@
 #include "config.h"
 
 static double Mhz;  /* estimated CPU clock frequency */
+#if !USE_FCYC
+static double last_secs; /* result of the most recent fsecs() */
+#endif
 
 extern int verbose; /* -v option in mdriver.c */
 
@@ -48,10 +51,32 @@ double fsecs(fsecs_test_funct f, void *argp)
     double cycles = fcyc(f, argp);
     return cycles/(Mhz*1e6);
 #elif USE_ITIMER
-    return ftimer_itimer(f, argp, 10);
+    return last_secs = ftimer_itimer(f, argp, 10);
 #elif USE_GETTOD
-    return ftimer_gettod(f, argp, 10);
+    return last_secs = ftimer_gettod(f, argp, 10);
 #endif 
 }
 
+/*
+ * fsecs_samples - Return the individual measurements (in seconds) behind
+ *     the most recent fsecs() call, best first. With the cycle counter
+ *     these are the K best samples; the timers only give their average.
+ */
+int fsecs_samples(double *secs, int max)
+{
+#if USE_FCYC
+    int i, n;
+
+    n = get_fcyc_kbest(secs, max);
+    for (i = 0; i < n; i++)
+        secs[i] /= Mhz*1e6;
+    return n;
+#else
+    if (max < 1)
+        return 0;
+    secs[0] = last_secs;
+    return 1;
+#endif
+}
+
 
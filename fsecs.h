@@ -1,4 +1,7 @@
 typedef void (*fsecs_test_funct)(void *);
 
+#define FSECS_MAXSAMPLES 8 /* most samples fsecs_samples() returns */
+
 void init_fsecs(void);
 double fsecs(fsecs_test_funct f, void *argp);
+int fsecs_samples(double *secs, int max);
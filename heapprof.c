@@ -0,0 +1,346 @@
+/*
+ * heapprof.c - Sampling heap profiler for the interposed mm package
+ *
+ * Sampling is by bytes, as in tcmalloc: each byte allocated is picked
+ * with probability 1/rate, so a request of size bytes is sampled with
+ * probability 1 - exp(-size/rate), and the distance to the next picked
+ * byte is exponentially distributed. The allocator keeps that distance
+ * in prof_countdown and takes each request off it, which is all that
+ * an unsampled request costs; only when it runs out does it call us.
+ *
+ * Live samples are kept in an open-addressed table of our own, mapped
+ * straight from the system, so the profiler never calls the malloc it
+ * is profiling. The allocator flags a sampled block in its header and
+ * tells us when it is freed. Profiles are written with nothing but
+ * write(2) on a stack buffer, so the SIGUSR2 handler can write one
+ * itself; if the signal lands while the table is being changed, the
+ * change writes the profile when it is done instead.
+ */
+#include <execinfo.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <math.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "heapprof.h"
+
+#define PROF_RATE   (512 * 1024)    /* default mean bytes between samples */
+#define PROF_SLOTS  (1 << 14)       /* slots in the table; a power of two */
+#define PROF_DEPTH  16              /* frames kept per sample */
+#define PROF_SKIP   2               /* our own frames: prof_sample, malloc */
+#define PROF_SIGNAL SIGUSR2
+
+typedef struct {
+    void *p;                /* the sampled payload, or NULL if free */
+    size_t size;            /* bytes asked for */
+    int depth;              /* frames in pc */
+    void *pc[PROF_DEPTH];   /* return addresses, innermost first */
+} sample_t;
+
+long prof_countdown = LONG_MAX;
+
+static int on;
+static char prefix[256];        /* profiles go to <prefix>.<pid>.<n>.heap */
+static double rate = PROF_RATE;
+static uint64_t rng;            /* xorshift64 state */
+static sample_t *table;         /* PROF_SLOTS samples */
+static unsigned long live, live_bytes;      /* samples in the table */
+static unsigned long total, total_bytes;    /* samples ever taken */
+static unsigned long dumps;                 /* profiles written */
+
+/* busy is set while the table changes; a signal then sets pending */
+static volatile sig_atomic_t busy, pending;
+#define BARRIER() __atomic_signal_fence(__ATOMIC_SEQ_CST)
+
+/*
+ * slot_of - Home slot of payload p
+ */
+static size_t slot_of(const void *p)
+{
+    return (size_t)(((uintptr_t)p >> 3) * 0x9e3779b97f4a7c15ULL >> 50) &
+           (PROF_SLOTS - 1);
+}
+
+/*
+ * next_countdown - Bytes until the next sampled byte: an exponential
+ *     variate with mean rate
+ */
+static long next_countdown(void)
+{
+    double u;
+
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    u = ((rng >> 11) + 1) * (1.0 / 9007199254740992.0);  /* (0, 1] */
+    return (long)(-log(u) * rate);
+}
+
+/*
+ * enter, leave - Bracket a change to the table, and write the profile
+ *     a signal asked for in the meantime
+ */
+static void enter(void)
+{
+    busy = 1;
+    BARRIER();
+}
+
+static void leave(void)
+{
+    BARRIER();
+    busy = 0;
+    if (pending) {
+        pending = 0;
+        prof_dump();
+    }
+}
+
+/*
+ * prof_signal - Write a profile now, or once the table is consistent
+ */
+static void prof_signal(int sig)
+{
+    (void)sig;
+    if (busy)
+        pending = 1;
+    else
+        prof_dump();
+}
+
+/*
+ * prof_init - Start profiling if MM_PROF names a prefix for the profiles
+ */
+void prof_init(void)
+{
+    const char *s = getenv("MM_PROF");
+    struct sigaction sa;
+    struct timespec ts;
+    void *pc[1];
+    long r;
+
+    if (on || s == NULL || *s == '\0' || strlen(s) >= sizeof(prefix))
+        return;
+    strcpy(prefix, s);
+    if ((s = getenv("MM_PROF_RATE")) != NULL && (r = atol(s)) > 0)
+        rate = r;
+    table = mmap(NULL, PROF_SLOTS * sizeof(sample_t), PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (table == MAP_FAILED) {
+        table = NULL;
+        return;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    rng = ((uint64_t)ts.tv_nsec << 20) ^ ts.tv_sec ^ getpid() ^ 1;
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = prof_signal;
+    sa.sa_flags = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    sigaction(PROF_SIGNAL, &sa, NULL);
+    atexit(prof_dump);
+
+    /* The first backtrace() loads the unwinder, which allocates */
+    busy = 1;
+    backtrace(pc, 1);
+    busy = 0;
+
+    on = 1;
+    prof_countdown = next_countdown();
+}
+
+/*
+ * prof_sample - The countdown ran out inside the request for p
+ */
+int prof_sample(void *p, size_t size)
+{
+    void *pc[PROF_DEPTH + PROF_SKIP];
+    sample_t *s;
+    size_t i;
+    int n;
+
+    if (!on) {
+        prof_countdown = LONG_MAX;
+        return 0;
+    }
+    prof_countdown = next_countdown();
+    if (busy || p == NULL || live >= PROF_SLOTS / 4 * 3)
+        return 0;
+
+    enter();
+    n = backtrace(pc, PROF_DEPTH + PROF_SKIP) - PROF_SKIP;
+    for (i = slot_of(p); table[i].p != NULL; i = (i + 1) & (PROF_SLOTS - 1))
+        ;
+    s = &table[i];
+    s->size = size;
+    s->depth = n > 0 ? n : 0;
+    if (n > 0)
+        memcpy(s->pc, pc + PROF_SKIP, n * sizeof(void *));
+    BARRIER();
+    s->p = p;
+    live++;
+    live_bytes += size;
+    total++;
+    total_bytes += size;
+    leave();
+    return 1;
+}
+
+/*
+ * prof_forget - Drop the sample of p. The slots after it that would
+ *     have gone in its slot or earlier are shifted back, so that the
+ *     table needs no tombstones.
+ */
+void prof_forget(void *p)
+{
+    size_t i, j, k;
+
+    if (!on)
+        return;
+    for (i = slot_of(p); table[i].p != p; i = (i + 1) & (PROF_SLOTS - 1))
+        if (table[i].p == NULL)
+            return;
+
+    enter();
+    live--;
+    live_bytes -= table[i].size;
+    for (;;) {
+        table[i].p = NULL;
+        j = i;
+        do {
+            j = (j + 1) & (PROF_SLOTS - 1);
+            if (table[j].p == NULL) {
+                leave();
+                return;
+            }
+            k = slot_of(table[j].p);
+        } while (i <= j ? (i < k && k <= j) : (i < k || k <= j));
+        table[i] = table[j];
+        i = j;
+    }
+}
+
+/*
+ * The profile is formatted by hand into a buffer on the stack, since
+ * stdio is off limits in a signal handler.
+ */
+typedef struct {
+    int fd;
+    size_t n;
+    char buf[4096];
+} out_t;
+
+static void out_flush(out_t *o)
+{
+    size_t done = 0;
+    ssize_t n;
+
+    while (done < o->n) {
+        if ((n = write(o->fd, o->buf + done, o->n - done)) <= 0)
+            break;
+        done += n;
+    }
+    o->n = 0;
+}
+
+static void out_str(out_t *o, const char *s)
+{
+    size_t len = strlen(s);
+
+    if (o->n + len > sizeof(o->buf))
+        out_flush(o);
+    memcpy(o->buf + o->n, s, len);
+    o->n += len;
+}
+
+static void out_num(out_t *o, unsigned long v, int base)
+{
+    char tmp[24];
+    int i = sizeof(tmp);
+
+    tmp[--i] = '\0';
+    do {
+        tmp[--i] = "0123456789abcdef"[v % base];
+        v /= base;
+    } while (v > 0);
+    if (base == 16) {
+        tmp[--i] = 'x';
+        tmp[--i] = '0';
+    }
+    out_str(o, tmp + i);
+}
+
+/*
+ * prof_dump - Write the live samples to the next profile file, in
+ *     the format of pprof's legacy heap profiles: a header with the
+ *     sampling rate, a line per sample, and the process's mappings
+ *     so the addresses can be symbolized
+ */
+void prof_dump(void)
+{
+    char name[sizeof(prefix) + 64];
+    out_t o;
+    size_t i;
+    ssize_t n;
+    int d, maps;
+
+    if (!on)
+        return;
+
+    o.n = 0;
+    o.fd = -1;
+    out_str(&o, prefix);
+    out_str(&o, ".");
+    out_num(&o, getpid(), 10);
+    out_str(&o, ".");
+    out_num(&o, dumps++, 10);
+    out_str(&o, ".heap");
+    memcpy(name, o.buf, o.n);
+    name[o.n] = '\0';
+    o.n = 0;
+    if ((o.fd = open(name, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0)
+        return;
+
+    out_str(&o, "heap profile: ");
+    out_num(&o, live, 10);
+    out_str(&o, ": ");
+    out_num(&o, live_bytes, 10);
+    out_str(&o, " [");
+    out_num(&o, total, 10);
+    out_str(&o, ": ");
+    out_num(&o, total_bytes, 10);
+    out_str(&o, "] @ heap_v2/");
+    out_num(&o, (unsigned long)rate, 10);
+    out_str(&o, "\n");
+    for (i = 0; i < PROF_SLOTS; i++) {
+        if (table[i].p == NULL)
+            continue;
+        out_str(&o, "1: ");
+        out_num(&o, table[i].size, 10);
+        out_str(&o, " [1: ");
+        out_num(&o, table[i].size, 10);
+        out_str(&o, "] @");
+        for (d = 0; d < table[i].depth; d++) {
+            out_str(&o, " ");
+            out_num(&o, (unsigned long)table[i].pc[d], 16);
+        }
+        out_str(&o, "\n");
+    }
+
+    out_str(&o, "\nMAPPED_LIBRARIES:\n");
+    out_flush(&o);
+    if ((maps = open("/proc/self/maps", O_RDONLY)) >= 0) {
+        while ((n = read(maps, o.buf, sizeof(o.buf))) > 0) {
+            o.n = n;
+            out_flush(&o);
+        }
+        close(maps);
+    }
+    close(o.fd);
+}
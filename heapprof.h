@@ -0,0 +1,29 @@
+/*
+ * heapprof.h - Sampling heap profiler for the interposed mm package
+ *
+ * When libmm.so is preloaded with MM_PROF=<prefix> in the environment,
+ * about one in every MM_PROF_RATE bytes allocated (512 KiB if unset)
+ * is sampled: its block is remembered with the call stack that asked
+ * for it until it is freed. On SIGUSR2 and at exit the live samples
+ * are written to <prefix>.<pid>.<n>.heap in pprof's heap profile
+ * format, which scales them back up to estimated bytes.
+ */
+#include <stddef.h>
+
+/* Bytes left to allocate before the next sample. The allocator takes
+   each request off it and calls prof_sample() once it goes negative;
+   it stays huge while profiling is off. */
+extern long prof_countdown;
+
+/* Read the environment and, if asked to, start profiling */
+extern void prof_init(void);
+
+/* Draw the next countdown and remember the size bytes at p with the
+   caller's stack. Returns nonzero if p was remembered. */
+extern int prof_sample(void *p, size_t size);
+
+/* p, which prof_sample() remembered, is being freed */
+extern void prof_forget(void *p);
+
+/* Write out a profile of the live samples now */
+extern void prof_dump(void);
@@ -0,0 +1,92 @@
+/*
+ * lathist.c - Log-bucketed latency histograms
+ *
+ * Values below LATHIST_SUB get a bucket each. Above that, the bucket
+ * is chosen by the position of the value's highest set bit and the
+ * LATHIST_SUB_BITS bits below it, so the buckets grow with the values
+ * and the relative error stays constant. Recording is a few shifts and
+ * an increment; no allocation happens after lathist_init().
+ */
+#include <string.h>
+
+#include "lathist.h"
+
+/* Index of the bucket that v falls into */
+static int bucket_of(unsigned long long v)
+{
+    int msb;
+
+    if (v < LATHIST_SUB)
+        return (int)v;
+    msb = 63 - __builtin_clzll(v);
+    return (msb - LATHIST_SUB_BITS + 1) * LATHIST_SUB +
+        (int)((v >> (msb - LATHIST_SUB_BITS)) & (LATHIST_SUB - 1));
+}
+
+/* Largest value that falls into bucket b */
+static unsigned long long bucket_max(int b)
+{
+    int shift;
+
+    if (b < LATHIST_SUB)
+        return b;
+    shift = b / LATHIST_SUB - 1;
+    return (((unsigned long long)(LATHIST_SUB + b % LATHIST_SUB) + 1) << shift) - 1;
+}
+
+/*
+ * lathist_init - Empty the histogram
+ */
+void lathist_init(lathist_t *h)
+{
+    memset(h, 0, sizeof(*h));
+}
+
+/*
+ * lathist_add - Record one value
+ */
+void lathist_add(lathist_t *h, unsigned long long v)
+{
+    h->count[bucket_of(v)]++;
+    h->n++;
+    if (v > h->max)
+        h->max = v;
+}
+
+/*
+ * lathist_merge - Add every value recorded in src to dst
+ */
+void lathist_merge(lathist_t *dst, const lathist_t *src)
+{
+    int b;
+
+    for (b = 0; b < LATHIST_BUCKETS; b++)
+        dst->count[b] += src->count[b];
+    dst->n += src->n;
+    if (src->max > dst->max)
+        dst->max = src->max;
+}
+
+/*
+ * lathist_percentile - Return the upper bound of the bucket holding the
+ *     pct-th percentile, but never more than the largest recorded value
+ */
+unsigned long long lathist_percentile(const lathist_t *h, double pct)
+{
+    unsigned long long rank, seen = 0, bound;
+    int b;
+
+    if (h->n == 0)
+        return 0;
+    rank = (unsigned long long)(pct / 100.0 * h->n + 0.5);
+    if (rank < 1)
+        rank = 1;
+    for (b = 0; b < LATHIST_BUCKETS; b++) {
+        seen += h->count[b];
+        if (seen >= rank) {
+            bound = bucket_max(b);
+            return bound < h->max ? bound : h->max;
+        }
+    }
+    return h->max;
+}
@@ -0,0 +1,34 @@
+/*
+ * lathist.h - prototypes for the routines in lathist.c that keep
+ *     log-bucketed latency histograms (in the style of HdrHistogram)
+ */
+
+/*
+ * Each power of two is split into 2^LATHIST_SUB_BITS linear buckets,
+ * so any recorded value is reported to within 1/2^LATHIST_SUB_BITS
+ * (about 3%) of its true value.
+ */
+#define LATHIST_SUB_BITS 5
+#define LATHIST_SUB      (1 << LATHIST_SUB_BITS)
+#define LATHIST_BUCKETS  ((64 - LATHIST_SUB_BITS + 1) * LATHIST_SUB)
+
+typedef struct {
+    unsigned long long count[LATHIST_BUCKETS];
+    unsigned long long n;     /* number of recorded values */
+    unsigned long long max;   /* largest recorded value */
+} lathist_t;
+
+/* lathist_init - Empty the histogram */
+void lathist_init(lathist_t *h);
+
+/* lathist_add - Record one value */
+void lathist_add(lathist_t *h, unsigned long long v);
+
+/* lathist_merge - Add every value recorded in src to dst */
+void lathist_merge(lathist_t *dst, const lathist_t *src);
+
+/*
+ * lathist_percentile - Return the smallest bucket bound that at least
+ *     pct percent of the recorded values fall at or below
+ */
+unsigned long long lathist_percentile(const lathist_t *h, double pct);
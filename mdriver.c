@@ -7,9 +7,11 @@
  * Copyright (c) 2004-2015, R. Bryant and D. O'Hallaron, All rights
  * reserved.  May not be used, modified, or copied without permission.
  */
+#define _GNU_SOURCE /* for sched_setaffinity() */
 #include <assert.h>
 #include <errno.h>
 #include <float.h>
+#include <limits.h>
 #include <setjmp.h>
 #include <signal.h>
 #include <stdarg.h>
@@ -18,11 +20,19 @@
 #include <string.h>
 #include <time.h>
 #include <unistd.h>
+#include <sched.h>
+#include <sys/wait.h>
 
 
 #include "mm.h"
 #include "memlib.h"
 #include "fsecs.h"
+#include "clock.h"
+#include "perfctr.h"
+#include "lathist.h"
+#include "rep.h"
+#include "allocators.h"
+#include "evlog.h"
 #include "config.h"
 
 /**********************
@@ -33,10 +43,16 @@
 #define MAXLINE     1024 /* max string size */
 #define HDRLINES       4 /* number of header lines in a trace file */
 #define LINENUM(i) (i+5) /* cnvt trace request nums to linenums (origin 1) */
+#define MAXPKGS        8 /* max number of malloc packages run by -a */
+#define MAXMAPS       16 /* max number of heap maps per trace (-H) */
+#define MAP_WIDTH    512 /* width of a heap map image, in pixels */
 
 /* Returns true if p is ALIGNMENT-byte aligned */
 #define IS_ALIGNED(p)  ((((unsigned long)(p)) % ALIGNMENT) == 0)
 
+/* Rounds size up to a multiple of ALIGNMENT */
+#define ALIGN(size) (((size) + (ALIGNMENT-1)) / ALIGNMENT * ALIGNMENT)
+
 /* weights */
 #define WNONE 0
 #define WALL 1
@@ -63,6 +79,7 @@ typedef struct range_t {
 } range_t;
 
 /* Characterizes a single trace operation (allocator request) */
+#define NUM_OPTYPES 3
 typedef struct {
     enum { ALLOC, FREE, REALLOC } type; /* type of request */
     int index;                        /* index for free() to use later */
@@ -92,6 +109,32 @@ typedef struct {
     range_t *ranges;
 } speed_t;
 
+/* Where the heap went at the point the payload peaked (-F) */
+typedef struct {
+    size_t live;      /* payload bytes at the peak */
+    size_t header;    /* headers, footers and the allocator's own data */
+    size_t rounding;  /* payloads rounded up to ALIGNMENT */
+    size_t unsplit;   /* usable bytes beyond the rounded payload */
+    size_t freelist;  /* bytes in free blocks */
+    size_t growth;    /* heap added after the peak */
+} waste_t;
+
+/* The free space in the heap at one point of a trace (-H) */
+typedef struct {
+    int opnum;          /* taken after this many requests */
+    size_t heapsize;    /* heap size at that point */
+    size_t free_blocks; /* number of free blocks */
+    size_t free_bytes;  /* and their total size */
+    size_t longest_run; /* most free bytes in a row */
+} heapmap_t;
+
+/* One round of a steady-state run (-S) */
+typedef struct {
+    double secs;     /* time to replay the trace on the warm heap */
+    double util;     /* peak payload / heap size after the round */
+    size_t heapsize; /* heap size after the round */
+} round_t;
+
 /* Summarizes the important stats for some malloc function on some trace */
 typedef struct {
     /* set in read_trace */
@@ -103,12 +146,85 @@ typedef struct {
     int valid;       /* was the trace processed correctly by the allocator? */
     double secs;     /* number of secs needed to run the trace */
 
+    double samples[FSECS_MAXSAMPLES]; /* the best measurements of secs */
+    int nsamples;    /* number of entries in samples */
+
     /* defined only for the student malloc package */
     double util;     /* space utilization for this trace (always 0 for libc) */
+    size_t heapsize; /* heap size after the correctness check */
+    size_t timed_heapsize; /* and after the timing run */
+
+    /* defined only if the footprint is sampled (-T) */
+    double avg_util;   /* live bytes / heap size, averaged over the run */
+    double worst_frag; /* largest fraction of the heap not holding data */
+
+    /* defined only if the waste breakdown is on (-F) */
+    waste_t waste;
+
+    /* defined only if heap maps are taken (-H) */
+    heapmap_t maps[MAXMAPS];
+    int nmaps;
+
+    /* defined only if the package's own statistics are on (-M) */
+    mm_stats_t heap; /* its counters at the end of the correctness check */
+
+    /* defined only if event counting (-P) or the huge page comparison
+       (-G) is on */
+    perfctr_t perf;  /* event counts over one run of the trace */
+
+    /* defined only if the huge page comparison (-G) is on */
+    double huge_secs;       /* secs, with the heap on huge pages */
+    perfctr_t huge_perf;    /* and the event counts of one run */
+    const char *huge_mode;  /* how the heap got them (see mem_hugepages) */
+    size_t huge_bytes;      /* bytes of the heap on transparent huge pages */
+
+    /* defined only if latency measurement (-L) is on */
+    lathist_t *lat;  /* counter ticks per call, indexed by request type */
+
+    /* defined only in steady-state mode (-S) */
+    round_t *rounds; /* one entry per round */
+
+#ifdef MM_INSTRUMENT
+    /* defined only for mm.c, over one more run of the trace */
+    mm_instr_t instr;
+#endif
 
     /* Note: secs and util are only defined if valid is true */
 } stats_t;
 
+/* What a worker process in run_tests_parallel reports about its trace */
+typedef struct {
+    int valid;       /* was the trace processed correctly? */
+    double util;     /* space utilization, if valid */
+    size_t heapsize; /* heap size after the correctness check */
+    double avg_util; /* footprint summary, if sampled */
+    double worst_frag;
+    waste_t waste;   /* waste breakdown, if asked for */
+    heapmap_t maps[MAXMAPS]; /* heap maps, if asked for */
+    int nmaps;
+    mm_stats_t heap; /* the package's counters, if asked for */
+    int errors;      /* number of errors found */
+} worker_result_t;
+
+/* The footprint samples of one run of a trace (-T) */
+typedef struct {
+    FILE *fp;          /* where the samples go */
+    int num_ops;       /* the last request is always sampled */
+    int nsamples;      /* number of samples taken */
+    double sum_util;   /* sum of live bytes / heap size */
+    double worst_frag; /* largest 1 - live bytes / heap size */
+} timeline_t;
+
+/* Running totals behind the waste breakdown of one run of a trace (-F) */
+typedef struct {
+    size_t *usable;     /* usable size of each live block, by id */
+    size_t *aligned;    /* payload size of each live block, rounded up */
+    size_t usable_sum;  /* sums of the above over the live blocks */
+    size_t aligned_sum;
+    size_t peak_heap;   /* heap size when the payload peaked */
+    waste_t peak;       /* the breakdown at that point */
+} wastetrack_t;
+
 /* Summarizes the key statistics for a set of traces */
 typedef struct {
     double util;  /* average utilization expressed as a percentage */
@@ -122,7 +238,8 @@ typedef struct {
  * at a "random" place (a hash of the index), and copy random data
  * into it.  With DBG_CHEAP, we check that the data survived when we
  * realloc and when we free.  With DBG_EXPENSIVE, we check every block
- * every operation.
+ * every operation.  DBG_INCREMENTAL does the same checks, but only on
+ * the blocks whose heap pages were written since the previous operation.
  * randint_t should be a byte, in case students return unaligned memory.
  *******************/
 #define RANDOM_DATA_LEN (1<<16)
@@ -135,7 +252,8 @@ static randint_t random_data[RANDOM_DATA_LEN];
  * Global variables
  *******************/
 
-static enum { DBG_NONE, DBG_CHEAP, DBG_EXPENSIVE } debug_mode = DBG_CHEAP;
+static enum { DBG_NONE, DBG_CHEAP, DBG_EXPENSIVE, DBG_INCREMENTAL }
+    debug_mode = DBG_CHEAP;
 
 int verbose = 1;        /* global flag for verbose output */
 static int errors = 0;  /* number of errs found when running student malloc */
@@ -144,6 +262,55 @@ int onetime_flag = 0;
 /* by default, no timeouts */
 static int set_timeout = 0;
 
+/* if set, count hardware events over one extra run of each trace (-P) */
+static int count_events = 0;
+
+/* if set, time every request of one extra run of each trace (-L) */
+static int measure_latency = 0;
+
+/* number of interleaved copies each trace is scaled up to (-x) */
+static int amplify = 1;
+
+/* if nonzero, replay each trace this many times on the same heap (-S) */
+static int steady_rounds = 0;
+
+/* if set, measure utilization during the correctness check instead of
+   in a pass of its own (cleared by -u) */
+static int fused_util = 1;
+
+/* if nonzero, sample the footprint every this many requests (-T) */
+static int timeline_every = 0;
+static timeline_t timeline;
+
+/* if set, break down the wasted space at the peak of each trace (-F) */
+static int show_waste = 0;
+
+/* the requests after which to take heap maps (-H) */
+static int map_ops[MAXMAPS];
+static int num_map_ops = 0;
+static stats_t *mapstats;        /* where the current trace's maps go */
+static const char *mapbase;      /* and the trace file's base name */
+
+/* if set, print the mm package's own statistics for each trace (-M) */
+static int show_heapstats = 0;
+
+/* if set, time each trace again with the heap on huge pages (-G) */
+static int huge_compare = 0;
+static wastetrack_t wastetrack;
+
+/* number of traces checked at once by worker processes (-j) */
+static int jobs = 1;
+
+/* the malloc package under test; -a runs others on the same traces */
+static const allocator_t *pkg = &allocators[0];
+
+/* if set, log the requests of mm.c's correctness checks here (-E) */
+static char *evlog_file = NULL;
+
+/* where to save the results (-o) and which report to compare with (-b) */
+static char *report_file = NULL;
+static char *baseline_file = NULL;
+
 /* Directory where default tracefiles are found */
 static char tracedir[MAXLINE] = TRACEDIR;
 
@@ -173,6 +340,21 @@ static void init_random_data(void);
 static void check_index(const trace_t *trace, int opnum, int index);
 static void randomize_block(trace_t *trace, int index);
 
+/* These functions record the footprint of the heap over time */
+static void timeline_start(const trace_t *trace);
+static void timeline_sample(int opnum, int live_bytes);
+static void timeline_end(stats_t *stats);
+
+/* These functions draw and measure the free space in the heap */
+static void heapmap_start(const trace_t *trace, stats_t *stats);
+static void heapmap_sample(int opnum);
+
+/* These functions account for the space the mm package wastes */
+static void waste_start(const trace_t *trace);
+static void waste_update(int index, void *p, size_t size);
+static void waste_sample(int live_bytes);
+static void waste_end(stats_t *stats);
+
 /* These functions read, allocate, and free storage for traces */
 static trace_t *read_trace(stats_t *stats, const char *tracedir,
                            const char *filename);
@@ -185,12 +367,41 @@ static void eval_libc_speed(void *ptr);
 
 /* Routines for evaluating correctnes, space utilization, and speed
    of the student's malloc package in mm.c */
-static int eval_mm_valid(trace_t *trace, range_t **ranges);
-static double eval_mm_util(trace_t *trace, int tracenum);
+static int eval_mm_valid(trace_t *trace, range_t **ranges, stats_t *stats);
+static int replay_mm_valid(trace_t *trace, range_t **ranges,
+                           int *max_total_size);
+static double eval_mm_util(trace_t *trace, int tracenum, stats_t *stats);
+static void check_fused_util(trace_t *trace, stats_t *stats, int tracenum);
 static void eval_mm_speed(void *ptr);
+static void replay_mm_speed(trace_t *trace);
+static void eval_mm_steady(trace_t *trace, round_t *rounds, int nrounds);
+static void eval_mm_latency(trace_t *trace, lathist_t *lat);
+
+/* Routines for running the whole set of traces */
+static void run_tests_parallel(int num_tracefiles, const char *tracedir,
+                               char **tracefiles, stats_t *mm_stats,
+                               range_t *ranges, speed_t *speed_params);
 
 /* Various helper routines */
 static void printresults(int n, stats_t *stats, sum_stats_t *sumstats);
+static void printevents(int n, stats_t *stats);
+static void printlatency(int n, stats_t *stats);
+static void printtimeline(int n, stats_t *stats);
+static void printwaste(int n, stats_t *stats);
+static void printsteady(int n, stats_t *stats);
+static void printheapstats(int n, stats_t *stats);
+static void printheapmaps(int n, stats_t *stats);
+static void printhugepages(int n, stats_t *stats);
+static void free_trace_stats(int n, stats_t *stats);
+#ifdef MM_INSTRUMENT
+static void printinstr(int n, stats_t *stats);
+#endif
+static void printcompare(int n, int npkgs, const allocator_t **pkgs,
+                         stats_t **stats, stats_t *libc_stats);
+static void write_report(const char *filename, int n, stats_t *stats,
+                         double util, double tput, double perfindex);
+static stats_t *read_report(const char *filename, int *n);
+static int compare_baseline(const char *filename, int n, stats_t *stats);
 static void usage(void);
 static void malloc_error(const trace_t *trace, int opnum, const char *fmt, ...)
     __attribute__((format(printf, 3,4)));
@@ -208,6 +419,64 @@ static void timeout_handler(int sig __attribute__((unused))) {
     longjmp(timeout_jmpbuf, 1);
 }
 
+/*
+ * time_trace - Measure the throughput of the mm package on a trace that
+ *     was found to be valid, plus the optional event counts and latencies
+ */
+static void time_trace(trace_t *trace, stats_t *stats, range_t *ranges,
+                       speed_t *speed_params)
+{
+    speed_params->trace = trace;
+    speed_params->ranges = ranges;
+    if (verbose > 1)
+        printf("and performance.\n");
+    stats->secs = fsecs(eval_mm_speed, speed_params);
+    stats->nsamples = fsecs_samples(stats->samples, FSECS_MAXSAMPLES);
+    stats->timed_heapsize = mem_heapsize();
+    if (count_events || huge_compare) {
+        perfctr_start();
+        eval_mm_speed(speed_params);
+        perfctr_stop(&stats->perf);
+    }
+    if (measure_latency) {
+        stats->lat = calloc(NUM_OPTYPES, sizeof(lathist_t));
+        if (stats->lat == NULL)
+            unix_error("calloc failed in time_trace");
+        eval_mm_latency(trace, stats->lat);
+    }
+    if (steady_rounds > 0) {
+        stats->rounds = calloc(steady_rounds, sizeof(round_t));
+        if (stats->rounds == NULL)
+            unix_error("calloc failed in time_trace");
+        eval_mm_steady(trace, stats->rounds, steady_rounds);
+    }
+#ifdef MM_INSTRUMENT
+    if (pkg == &allocators[0]) {
+        eval_mm_speed(speed_params);
+        stats->instr = mm_instr;
+    }
+#endif
+    if (huge_compare) {
+        /* The same again on a fresh heap of huge pages, then back */
+        mem_deinit();
+        mem_set_hugepages(1);
+        mem_init();
+        stats->huge_mode = mem_hugepages();
+        stats->huge_secs = fsecs(eval_mm_speed, speed_params);
+        perfctr_start();
+        eval_mm_speed(speed_params);
+        perfctr_stop(&stats->huge_perf);
+        stats->huge_bytes = mem_huge_resident();
+        mem_deinit();
+        mem_set_hugepages(0);
+        mem_init();
+
+        /* Leave the caller a heap with the trace replayed on it, as
+           every other pass does, rather than an empty one */
+        eval_mm_speed(speed_params);
+    }
+}
+
 /* Run the tests; return the number of tests run (may be less than
    num_tracefiles, if there's a timeout) */
 static void run_tests(int num_tracefiles, const char *tracedir,
@@ -216,6 +485,12 @@ static void run_tests(int num_tracefiles, const char *tracedir,
     volatile int i;
     volatile int timed_out = 0;
 
+    if (jobs > 1 && !onetime_flag) {
+        run_tests_parallel(num_tracefiles, tracedir, tracefiles,
+                           mm_stats, ranges, speed_params);
+        return;
+    }
+
     for (i=0; i < num_tracefiles; i++) {
         /* initialize simulated memory system in memlib.c *
          * start each trace with a clean system */
@@ -235,7 +510,7 @@ static void run_tests(int num_tracefiles, const char *tracedir,
         } else {
             if (verbose > 1)
                 printf("Checking mm_malloc for correctness, ");
-            mm_stats[i].valid = eval_mm_valid(trace, &ranges);
+            mm_stats[i].valid = eval_mm_valid(trace, &ranges, &mm_stats[i]);
 
             if (onetime_flag) {
                 free_trace(trace);
@@ -245,12 +520,10 @@ static void run_tests(int num_tracefiles, const char *tracedir,
         if (mm_stats[i].valid) {
             if (verbose > 1)
                 printf("efficiency, ");
-            mm_stats[i].util = eval_mm_util(trace, i);
-            speed_params->trace = trace;
-            speed_params->ranges = ranges;
-            if (verbose > 1)
-                printf("and performance.\n");
-            mm_stats[i].secs = fsecs(eval_mm_speed, speed_params);
+            if (!fused_util)
+                mm_stats[i].util = eval_mm_util(trace, i, &mm_stats[i]);
+            time_trace(trace, &mm_stats[i], ranges, speed_params);
+            check_fused_util(trace, &mm_stats[i], i);
         }
 
         free_trace(trace);
@@ -260,12 +533,170 @@ static void run_tests(int num_tracefiles, const char *tracedir,
     }
 }
 
+/*
+ * check_trace - The job of one worker process in run_tests_parallel():
+ *     check trace i for correctness and utilization and write the
+ *     outcome to fd. The heap and the mm package are global state, so
+ *     each trace gets a process of its own.
+ */
+static void check_trace(int fd, int i, const char *tracedir, char **tracefiles,
+                        stats_t *stats, range_t *ranges)
+{
+    worker_result_t result;
+    trace_t *trace;
+
+    /* Report only this trace's errors; the parent already has its own */
+    errors = 0;
+    mem_init();
+    trace = read_trace(stats, tracedir, tracefiles[i]);
+    if (verbose > 1)
+        printf("Checking %s for correctness and efficiency\n", trace->filename);
+    result.valid = eval_mm_valid(trace, &ranges, stats);
+    if (result.valid && !fused_util)
+        stats->util = eval_mm_util(trace, i, stats);
+    result.util = stats->util;
+    result.heapsize = stats->heapsize;
+    result.avg_util = stats->avg_util;
+    result.worst_frag = stats->worst_frag;
+    result.waste = stats->waste;
+    memcpy(result.maps, stats->maps, sizeof(result.maps));
+    result.nmaps = stats->nmaps;
+    result.heap = stats->heap;
+    result.errors = errors;
+
+    if (write(fd, &result, sizeof(result)) != sizeof(result))
+        exit(1);
+    exit(0);
+}
+
+/*
+ * run_tests_parallel - Like run_tests, but check the traces for
+ *     correctness and utilization in up to jobs worker processes at once.
+ *     The results come back over pipes. The timing runs afterwards, one
+ *     trace at a time, on a single CPU, so they don't disturb each other.
+ */
+static void run_tests_parallel(int num_tracefiles, const char *tracedir,
+                               char **tracefiles, stats_t *mm_stats,
+                               range_t *ranges, speed_t *speed_params)
+{
+    pid_t *pids;
+    int *fds;
+    int i;
+    volatile int running = 0; /* number of busy workers */
+    volatile int next = 0;    /* next trace to hand to a worker */
+    volatile int timing = 0;  /* next trace to time */
+    cpu_set_t cpus;
+
+    if ((pids = calloc(num_tracefiles, sizeof(pid_t))) == NULL ||
+        (fds = calloc(num_tracefiles, sizeof(int))) == NULL)
+        unix_error("calloc failed in run_tests_parallel");
+
+    for (i = 0; i < num_tracefiles; i++) {
+        strcpy(mm_stats[i].filename, tracedir);
+        strcat(mm_stats[i].filename, tracefiles[i]);
+    }
+
+    /* On a timeout, stop the workers; whatever wasn't timed is invalid */
+    if (setjmp(timeout_jmpbuf) != 0) {
+        for (i = 0; i < next; i++)
+            if (pids[i] > 0)
+                kill(pids[i], SIGKILL);
+        for (i = timing; i < num_tracefiles; i++)
+            mm_stats[i].valid = 0;
+        return;
+    }
+
+    while (next < num_tracefiles || running > 0) {
+        worker_result_t result;
+        int status;
+        pid_t pid;
+
+        /* Keep up to jobs workers busy */
+        while (next < num_tracefiles && running < jobs) {
+            int fd[2];
+
+            if (pipe(fd) < 0)
+                unix_error("pipe failed in run_tests_parallel");
+            if ((pids[next] = fork()) < 0)
+                unix_error("fork failed in run_tests_parallel");
+            if (pids[next] == 0) {
+                close(fd[0]);
+                check_trace(fd[1], next, tracedir, tracefiles,
+                            &mm_stats[next], ranges);
+            }
+            close(fd[1]);
+            fds[next] = fd[0];
+            next++;
+            running++;
+        }
+
+        /* Collect whichever worker finishes first */
+        if ((pid = wait(&status)) < 0) {
+            if (errno == EINTR)
+                continue;
+            unix_error("wait failed in run_tests_parallel");
+        }
+        for (i = 0; i < next && pids[i] != pid; i++)
+            ;
+        if (i == next)
+            continue;
+        pids[i] = 0;
+        running--;
+
+        if (read(fds[i], &result, sizeof(result)) == sizeof(result)) {
+            mm_stats[i].valid = result.valid;
+            mm_stats[i].util = result.util;
+            mm_stats[i].heapsize = result.heapsize;
+            mm_stats[i].avg_util = result.avg_util;
+            mm_stats[i].worst_frag = result.worst_frag;
+            mm_stats[i].waste = result.waste;
+            memcpy(mm_stats[i].maps, result.maps, sizeof(result.maps));
+            mm_stats[i].nmaps = result.nmaps;
+            mm_stats[i].heap = result.heap;
+            errors += result.errors;
+        } else {
+            /* The worker crashed or bailed out before reporting */
+            printf("ERROR [trace %s]: checking process ", mm_stats[i].filename);
+            if (WIFSIGNALED(status))
+                printf("killed by signal %d\n", WTERMSIG(status));
+            else
+                printf("exited with status %d\n", WEXITSTATUS(status));
+            mm_stats[i].valid = 0;
+            errors++;
+        }
+        close(fds[i]);
+    }
+    free(pids);
+    free(fds);
+
+    /* Time the valid traces one after the other on the CPU we're on */
+    CPU_ZERO(&cpus);
+    CPU_SET(sched_getcpu(), &cpus);
+    if (sched_setaffinity(0, sizeof(cpus), &cpus) < 0 && verbose > 1)
+        printf("Could not pin the timing runs to one CPU: %s\n",
+               strerror(errno));
+
+    for (; timing < num_tracefiles; timing++) {
+        trace_t *trace;
+
+        mem_init();
+        trace = read_trace(&mm_stats[timing], tracedir, tracefiles[timing]);
+        mm_stats[timing].ops = trace->num_ops;
+        if (mm_stats[timing].valid) {
+            time_trace(trace, &mm_stats[timing], ranges, speed_params);
+            check_fused_util(trace, &mm_stats[timing], timing);
+        }
+        free_trace(trace);
+        mem_deinit();
+    }
+}
+
 /**************
  * Main routine
  **************/
 int main(int argc, char **argv)
 {
-    int i;
+    int i, k;
     char c;
     char **tracefiles = NULL;  /* null-terminated array of trace file names */
     int num_tracefiles = 0;    /* the number of traces in that array */
@@ -275,7 +706,14 @@ int main(int argc, char **argv)
     stats_t *mm_stats = NULL;  /* mm (i.e. student) stats for each trace */
     speed_t speed_params;      /* input parameters to the xx_speed routines */
 
+    const allocator_t *pkgs[MAXPKGS]; /* the packages to run (-a), */
+    stats_t *pkg_stats[MAXPKGS];      /* and their stats for each trace; */
+    int npkgs = 0;                    /* the first one is scored */
+    sum_stats_t pkg_sum_stats;
+    int pkg_errors;
+
     int run_libc = 0;     /* If set, run libc malloc (set by -l) */
+    int regressions = 0;  /* number of traces worse than the baseline */
     int autograder = 0;   /* if set then called by autograder (-A) */
     int checkpoint = 0;
 
@@ -291,7 +729,7 @@ int main(int argc, char **argv)
     /*
      * Read and interpret the command line arguments
      */
-    while ((c = getopt(argc, argv, "d:f:c:s:t:v:hpVAlD")) != EOF) {
+    while ((c = getopt(argc, argv, "a:d:f:c:s:t:v:o:b:j:C:E:H:S:T:x:hpuVAlDPLFMG")) != EOF) {
         switch (c) {
 
         case 'A': /* Hidden Autolab driver argument */
@@ -332,6 +770,32 @@ int main(int argc, char **argv)
             run_libc = 1;
             break;
 
+        case 'a': /* Run these malloc packages; the first one is scored */
+            {
+                char *name;
+
+                npkgs = 0;
+                for (name = strtok(optarg, ","); name != NULL;
+                     name = strtok(NULL, ",")) {
+                    if (strcmp(name, "libc") == 0) {
+                        run_libc = 1;
+                    } else if (strcmp(name, "all") == 0) {
+                        run_libc = 1;
+                        for (k = 0; allocators[k].name != NULL; k++) {
+                            if (npkgs == MAXPKGS)
+                                app_error("-a: more than %d packages", MAXPKGS);
+                            pkgs[npkgs++] = &allocators[k];
+                        }
+                    } else {
+                        if (npkgs == MAXPKGS)
+                            app_error("-a: more than %d packages", MAXPKGS);
+                        if ((pkgs[npkgs++] = find_allocator(name)) == NULL)
+                            app_error("-a: no malloc package called %s", name);
+                    }
+                }
+            }
+            break;
+
         case 'V': /* Increase verbosity level */
             verbose += 1;
             break;
@@ -352,6 +816,93 @@ int main(int argc, char **argv)
             set_timeout = atoi(optarg);
             break;
 
+        case 'P': /* Count hardware events */
+            count_events = 1;
+            break;
+
+        case 'L': /* Measure the latency of each request */
+            measure_latency = 1;
+            break;
+
+        case 'F': /* Break down the wasted space at the peak */
+            show_waste = 1;
+            break;
+
+        case 'H': /* Draw the heap after these numbers of requests */
+            {
+                char *num;
+
+                num_map_ops = 0;
+                for (num = strtok(optarg, ","); num != NULL;
+                     num = strtok(NULL, ",")) {
+                    if (num_map_ops == MAXMAPS)
+                        app_error("-H: more than %d heap maps", MAXMAPS);
+                    map_ops[num_map_ops++] = atoi(num);
+                }
+            }
+            break;
+
+        case 'M': /* Print the mm package's own statistics */
+            show_heapstats = 1;
+            break;
+
+        case 'G': /* Compare the throughput on a huge page heap */
+            huge_compare = 1;
+            break;
+
+        case 'S': /* Replay each trace on a warm heap for so many rounds */
+            steady_rounds = atoi(optarg);
+            break;
+
+        case 'C': /* Set a tunable parameter of the mm package */
+            {
+                char *eq = strchr(optarg, '=');
+
+                if (eq == NULL)
+                    app_error("-C needs name=value, not %s", optarg);
+                *eq = '\0';
+                if (mm_setparam(optarg, eq + 1) < 0)
+                    app_error("mm_setparam rejected %s=%s", optarg, eq + 1);
+            }
+            break;
+
+        case 'x': /* Scale each trace up by interleaving copies of it */
+            amplify = atoi(optarg);
+            if (amplify < 1)
+                app_error("-x needs a positive number of copies");
+            /* The heap is addressed by int offsets, and mem_sbrk takes an int */
+            if ((size_t)MAX_HEAP * amplify > INT_MAX)
+                app_error("-x %d makes a heap over %d bytes; use at most -x %d",
+                          amplify, INT_MAX, (int)(INT_MAX / MAX_HEAP));
+            mem_set_max_heap((size_t)MAX_HEAP * amplify);
+            break;
+
+        case 'T': /* Sample the footprint every so many requests */
+            timeline_every = atoi(optarg);
+            break;
+
+        case 'u': /* Measure utilization in a pass of its own */
+            fused_util = 0;
+            break;
+
+        case 'j': /* Check traces in parallel; 0 means one job per CPU */
+            jobs = atoi(optarg);
+            if (jobs <= 0)
+                jobs = sysconf(_SC_NPROCESSORS_ONLN);
+            break;
+
+        case 'E': /* Log the requests mm.c serves in a binary file */
+            evlog_file = strdup(optarg);
+            break;
+
+        case 'o': /* Save the results in a JSON or CSV report */
+            report_file = strdup(optarg);
+            break;
+
+        case 'b': /* Compare the results with a saved report */
+            baseline_file = strdup(optarg);
+            break;
+
         case 'h': /* Print this message */
             usage();
             exit(0);
@@ -362,6 +913,10 @@ int main(int argc, char **argv)
         }
     }
 
+    if (npkgs == 0)
+        pkgs[npkgs++] = &allocators[0];
+    pkg = pkgs[0];
+
     if (tracefiles == NULL) {
         tracefiles = default_tracefiles;
         num_tracefiles = sizeof(default_tracefiles) / sizeof(char *) - 1;
@@ -374,6 +929,21 @@ int main(int argc, char **argv)
 
     /* Initialize the timing package */
     init_fsecs();
+    if (count_events || huge_compare) {
+        const char *source = perfctr_init();
+        if (verbose)
+            printf("Counting events with %s.\n", source);
+    }
+
+    /* The log is written by a thread, which forked workers don't have */
+    if (evlog_file != NULL) {
+        const char *err = evlog_open(evlog_file);
+
+        if (err != NULL)
+            app_error("cannot log to %s: %s", evlog_file, err);
+        evlog_on = 0;
+        jobs = 1;
+    }
 
     /* Initialize the timeout */
     if (set_timeout > 0) {
@@ -405,6 +975,13 @@ int main(int argc, char **argv)
                 if (verbose > 1)
                     printf("and performance.\n");
                 libc_stats[i].secs = fsecs(eval_libc_speed, &speed_params);
+                libc_stats[i].nsamples = fsecs_samples(libc_stats[i].samples,
+                                                       FSECS_MAXSAMPLES);
+                if (count_events) {
+                    perfctr_start();
+                    eval_libc_speed(&speed_params);
+                    perfctr_stop(&libc_stats[i].perf);
+                }
             }
             free_trace(trace);
         }
@@ -414,6 +991,8 @@ int main(int argc, char **argv)
         if (verbose) {
             printf("\nResults for libc malloc:\n");
             printresults(num_tracefiles, libc_stats, &global_libc_sum_stats);
+            if (count_events)
+                printevents(num_tracefiles, libc_stats);
         }
     }
 
@@ -421,7 +1000,7 @@ int main(int argc, char **argv)
      * Always run and evaluate the student's mm package
      */
     if (verbose > 1)
-        printf("\nTesting mm malloc\n");
+        printf("\nTesting %s malloc\n", pkg->name);
 
     /* Allocate the mm stats array, with one stats_t struct per tracefile */
     mm_stats = (stats_t *)calloc(num_tracefiles, sizeof(stats_t));
@@ -442,11 +1021,32 @@ int main(int argc, char **argv)
                 printf(" => incorrect.\n\n");
             }
         } else {
-            printf("\nResults for mm malloc:\n");
+            printf("\nResults for %s malloc:\n", pkg->name);
             printresults(num_tracefiles, mm_stats, &global_mm_sum_stats);
+            if (count_events)
+                printevents(num_tracefiles, mm_stats);
+            if (measure_latency)
+                printlatency(num_tracefiles, mm_stats);
+            if (timeline_every > 0)
+                printtimeline(num_tracefiles, mm_stats);
+            if (show_waste)
+                printwaste(num_tracefiles, mm_stats);
+            if (show_heapstats)
+                printheapstats(num_tracefiles, mm_stats);
+            if (num_map_ops > 0)
+                printheapmaps(num_tracefiles, mm_stats);
+            if (huge_compare)
+                printhugepages(num_tracefiles, mm_stats);
+#ifdef MM_INSTRUMENT
+            if (pkg == &allocators[0])
+                printinstr(num_tracefiles, mm_stats);
+#endif
+            if (steady_rounds > 0)
+                printsteady(num_tracefiles, mm_stats);
             printf("\n");
         }
     }
+    free_trace_stats(num_tracefiles, mm_stats);
 
     /* Optionally compare the performance of mm and libc */
     if (run_libc) {
@@ -455,6 +1055,34 @@ int main(int argc, char **argv)
                (float)(global_mm_sum_stats.tput/global_libc_sum_stats.tput));
     }
 
+    /*
+     * Optionally run the other packages chosen with -a on the same
+     * traces. Only the first package is scored, so their errors do not
+     * count against it.
+     */
+    pkg_stats[0] = mm_stats;
+    pkg_errors = errors;
+    for (k = 1; k < npkgs; k++) {
+        pkg = pkgs[k];
+        if (verbose > 1)
+            printf("\nTesting %s malloc\n", pkg->name);
+        pkg_stats[k] = (stats_t *)calloc(num_tracefiles, sizeof(stats_t));
+        if (pkg_stats[k] == NULL)
+            unix_error("pkg_stats calloc in main failed");
+        run_tests(num_tracefiles, tracedir, tracefiles, pkg_stats[k],
+                  ranges, &speed_params);
+        if (verbose && !onetime_flag) {
+            printf("\nResults for %s malloc:\n", pkg->name);
+            printresults(num_tracefiles, pkg_stats[k], &pkg_sum_stats);
+        }
+        free_trace_stats(num_tracefiles, pkg_stats[k]);
+    }
+    pkg = pkgs[0];
+    errors = pkg_errors;
+    if (npkgs > 1 && !onetime_flag)
+        printcompare(num_tracefiles, npkgs, pkgs, pkg_stats,
+                     run_libc ? libc_stats : NULL);
+
     /*
      * Accumulate the aggregate statistics for the student's mm package
      */
@@ -555,6 +1183,19 @@ int main(int argc, char **argv)
         printf("Terminated with %d errors\n", errors);
     }
 
+    /* Optionally save the results and compare them with a baseline */
+    if (report_file != NULL)
+        write_report(report_file, num_tracefiles, mm_stats,
+                     avg_mm_util, avg_mm_throughput, perfindex);
+    if (baseline_file != NULL)
+        regressions = compare_baseline(baseline_file, num_tracefiles, mm_stats);
+    if (evlog_file != NULL) {
+        const char *err = evlog_close();
+
+        if (err != NULL)
+            app_error("cannot log to %s: %s", evlog_file, err);
+    }
+
     /* Optionally emit autoresult string */
     double raw_score = perfindex;
     double checkpoint_score = perfindex;
@@ -575,7 +1216,7 @@ int main(int argc, char **argv)
                 avg_mm_throughput/1000.0, avg_mm_util*100);
         printf("%s\n", autoresult);
     }
-    exit(0);
+    exit(regressions > 0 ? 2 : 0);
 }
 
 
@@ -741,6 +1382,209 @@ static void check_index(const trace_t *trace, int opnum, int index) {
     }
 }
 
+/**********************************************
+ * The following routines sample the footprint of the heap every
+ * timeline_every requests. Each sample goes to a CSV file named after
+ * the trace, and is summarized as the time-averaged utilization and
+ * the worst fragmentation seen during the run.
+ *********************************************/
+
+static void timeline_start(const trace_t *trace) {
+    char filename[MAXLINE + sizeof(".timeline.csv")];
+    const char *base;
+
+    if(timeline_every <= 0) return;
+
+    base = strrchr(trace->filename, '/');
+    base = (base != NULL) ? base + 1 : trace->filename;
+    snprintf(filename, sizeof(filename), "%s.timeline.csv", base);
+
+    memset(&timeline, 0, sizeof(timeline));
+    timeline.num_ops = trace->num_ops;
+    if((timeline.fp = fopen(filename, "w")) == NULL)
+        unix_error("Could not open %s in timeline_start", filename);
+    fprintf(timeline.fp, "op,live,heap,resident\n");
+}
+
+static void timeline_sample(int opnum, int live_bytes) {
+    size_t heap;
+
+    if(timeline_every <= 0) return;
+    if((opnum + 1) % timeline_every != 0 && opnum + 1 != timeline.num_ops)
+        return;
+
+    heap = mem_heapsize();
+    fprintf(timeline.fp, "%d,%d,%zu,%zu\n",
+            opnum + 1, live_bytes, heap, mem_resident());
+    if(heap == 0) return;
+
+    timeline.nsamples++;
+    timeline.sum_util += (double)live_bytes / heap;
+    if(1.0 - (double)live_bytes / heap > timeline.worst_frag)
+        timeline.worst_frag = 1.0 - (double)live_bytes / heap;
+}
+
+static void timeline_end(stats_t *stats) {
+    if(timeline_every <= 0) return;
+
+    fclose(timeline.fp);
+    stats->avg_util = (timeline.nsamples == 0) ? 0 :
+        timeline.sum_util / timeline.nsamples;
+    stats->worst_frag = timeline.worst_frag;
+}
+
+/**********************************************
+ * The following routines split the space wasted at the payload peak
+ * into block overhead (heap size less free and usable bytes), rounding
+ * of the requests to ALIGNMENT, usable bytes left over because place()
+ * didn't split the block, and bytes in free blocks. Together with the
+ * heap added after the peak, they account for the whole final heap.
+ *********************************************/
+
+static void waste_start(const trace_t *trace) {
+    if(!show_waste) return;
+
+    memset(&wastetrack, 0, sizeof(wastetrack));
+    wastetrack.usable = calloc(trace->num_ids, sizeof(size_t));
+    wastetrack.aligned = calloc(trace->num_ids, sizeof(size_t));
+    if(wastetrack.usable == NULL || wastetrack.aligned == NULL)
+        unix_error("calloc failed in waste_start");
+}
+
+static void waste_update(int index, void *p, size_t size) {
+    if(wastetrack.usable == NULL || index < 0) return;
+
+    wastetrack.usable_sum -= wastetrack.usable[index];
+    wastetrack.aligned_sum -= wastetrack.aligned[index];
+    wastetrack.usable[index] = (p != NULL) ? pkg->usable_size(p) : 0;
+    wastetrack.aligned[index] = (p != NULL) ? ALIGN(size) : 0;
+    wastetrack.usable_sum += wastetrack.usable[index];
+    wastetrack.aligned_sum += wastetrack.aligned[index];
+}
+
+static void waste_sample(int live_bytes) {
+    waste_t *w = &wastetrack.peak;
+    size_t free_bytes;
+
+    if(wastetrack.usable == NULL || (size_t)live_bytes <= w->live) return;
+
+    free_bytes = pkg->free_bytes();
+    wastetrack.peak_heap = mem_heapsize();
+    w->live = live_bytes;
+    w->rounding = wastetrack.aligned_sum - live_bytes;
+    w->unsplit = wastetrack.usable_sum - wastetrack.aligned_sum;
+    w->freelist = free_bytes;
+    w->header = wastetrack.peak_heap - free_bytes - wastetrack.usable_sum;
+}
+
+static void waste_end(stats_t *stats) {
+    if(wastetrack.usable == NULL) return;
+
+    wastetrack.peak.growth = mem_heapsize() - wastetrack.peak_heap;
+    stats->waste = wastetrack.peak;
+    free(wastetrack.usable);
+    free(wastetrack.aligned);
+    wastetrack.usable = wastetrack.aligned = NULL;
+}
+
+/**********************************************
+ * The following routines take heap maps during the correctness check,
+ * after the requests chosen with -H. A map is a PGM image named after
+ * the trace and the request, with MAP_WIDTH pixels to a row and a few
+ * bytes of the heap to a pixel: black is free, white is allocated (or
+ * the package's own data) and shades in between are a mix. We also
+ * measure the free blocks, and the longest run of free bytes.
+ *********************************************/
+
+/* What the heap walk collects for one map */
+typedef struct {
+    heapmap_t *map;
+    size_t run;            /* free bytes in a row so far */
+    size_t bytes_per_px;
+    size_t *free_px;       /* free bytes in each pixel */
+} heapwalk_t;
+
+static void heapmap_start(const trace_t *trace, stats_t *stats) {
+    if(num_map_ops == 0) return;
+
+    mapstats = stats;
+    mapstats->nmaps = 0;
+    mapbase = strrchr(trace->filename, '/');
+    mapbase = (mapbase != NULL) ? mapbase + 1 : trace->filename;
+}
+
+static void heapmap_block(size_t offset, size_t size, int alloc, void *arg) {
+    heapwalk_t *w = arg;
+    size_t px, lo, hi;
+
+    if(alloc) {
+        w->run = 0;
+        return;
+    }
+    w->map->free_blocks++;
+    w->map->free_bytes += size;
+    w->run += size;
+    if(w->run > w->map->longest_run)
+        w->map->longest_run = w->run;
+
+    /* Spread the block over the pixels it covers */
+    for(px = offset / w->bytes_per_px; px * w->bytes_per_px < offset + size;
+        px++) {
+        lo = px * w->bytes_per_px;
+        hi = lo + w->bytes_per_px;
+        w->free_px[px] += (hi < offset + size ? hi : offset + size) -
+            (lo > offset ? lo : offset);
+    }
+}
+
+static void heapmap_sample(int opnum) {
+    char filename[MAXLINE + 32];
+    heapwalk_t w;
+    size_t npx, rows, px, bytes;
+    FILE *fp;
+    int k;
+
+    if(mapstats == NULL) return;
+    for(k = 0; k < num_map_ops && map_ops[k] != opnum; k++)
+        ;
+    if(k == num_map_ops) return;
+
+    w.map = &mapstats->maps[mapstats->nmaps++];
+    memset(w.map, 0, sizeof(*w.map));
+    w.map->opnum = opnum;
+    w.map->heapsize = mem_heapsize();
+    w.run = 0;
+
+    /* Aim for a square image at most MAP_WIDTH pixels high */
+    w.bytes_per_px = (w.map->heapsize + MAP_WIDTH * MAP_WIDTH - 1) /
+        (MAP_WIDTH * MAP_WIDTH);
+    w.bytes_per_px = ALIGN(w.bytes_per_px > 0 ? w.bytes_per_px : 1);
+    npx = (w.map->heapsize + w.bytes_per_px - 1) / w.bytes_per_px;
+    rows = (npx + MAP_WIDTH - 1) / MAP_WIDTH;
+    if((w.free_px = calloc(rows * MAP_WIDTH + 1, sizeof(size_t))) == NULL)
+        unix_error("calloc failed in heapmap_sample");
+    pkg->heap_walk(heapmap_block, &w);
+
+    snprintf(filename, sizeof(filename), "%s.%d.pgm", mapbase, opnum);
+    if((fp = fopen(filename, "wb")) == NULL)
+        unix_error("Could not open %s in heapmap_sample", filename);
+    fprintf(fp, "P5\n# %s after %d requests, %zu bytes per pixel\n%d %zu\n255\n",
+            mapbase, opnum, w.bytes_per_px, MAP_WIDTH, rows);
+    for(px = 0; px < rows * MAP_WIDTH; px++) {
+        /* Gray past the end of the heap */
+        if(px >= npx) {
+            putc(128, fp);
+            continue;
+        }
+        bytes = w.map->heapsize - px * w.bytes_per_px;
+        if(bytes > w.bytes_per_px)
+            bytes = w.bytes_per_px;
+        putc(255 - (int)(255 * w.free_px[px] / bytes), fp);
+    }
+    fclose(fp);
+    free(w.free_px);
+}
+
 /**********************************************
  * The following routines manipulate tracefiles
  *********************************************/
@@ -751,12 +1595,10 @@ static void check_index(const trace_t *trace, int opnum, int index) {
 static trace_t *read_trace(stats_t *stats, const char *tracedir,
                            const char *filename)
 {
-    FILE *tracefile;
     trace_t *trace;
-    char type[MAXLINE];
-    int index, size;
-    int max_index = 0;
-    int op_index;
+    rep_t rep;
+    const char *err;
+    int i;
 
     if (verbose > 1)
         printf("Reading tracefile: %s\n", filename);
@@ -765,24 +1607,40 @@ static trace_t *read_trace(stats_t *stats, const char *tracedir,
     if ((trace = (trace_t *) malloc(sizeof(trace_t))) == NULL)
         unix_error("malloc 1 failed in read_trace");
 
-    /* Read the trace file header */
+    /* Read the trace file */
     strcpy(trace->filename, tracedir);
     strcat(trace->filename, filename);
-    if ((tracefile = fopen(trace->filename, "r")) == NULL) {
-        unix_error("Could not open %s in read_trace", trace->filename);
-    }
-    fscanf(tracefile, "%d", &trace->weight);
-    fscanf(tracefile, "%d", &trace->num_ids);
-    fscanf(tracefile, "%d", &trace->num_ops);
-    fscanf(tracefile, "%d", &trace->ignore_ranges);
+    if ((err = rep_read(trace->filename, &rep)) != NULL)
+        app_error("%s in read_trace", err);
 
-    if(trace->weight < 0 || trace->weight > 3) {
+    if(rep.weight < 0 || rep.weight > 3) {
         app_error("%s: weight can only be in {0, 1, 2 3}", trace->filename);
     }
-    if(trace->ignore_ranges != 0 && trace->ignore_ranges != 1) {
+    if(rep.ignore_ranges != 0 && rep.ignore_ranges != 1) {
         app_error("%s: ignore-ranges can only be zero or one", trace->filename);
     }
 
+    /* Scale the trace up by interleaving copies of it (-x) */
+    if (amplify > 1) {
+        const rep_t **copies;
+        rep_t mixed;
+
+        if ((copies = malloc(amplify * sizeof(rep_t *))) == NULL)
+            unix_error("malloc failed in read_trace");
+        for (i = 0; i < amplify; i++)
+            copies[i] = &rep;
+        if ((err = rep_mix(&mixed, copies, amplify)) != NULL)
+            app_error("%s: %s", trace->filename, err);
+        free(copies);
+        rep_free(&rep);
+        rep = mixed;
+    }
+
+    trace->weight = rep.weight;
+    trace->num_ids = rep.num_ids;
+    trace->num_ops = rep.num_ops;
+    trace->ignore_ranges = rep.ignore_ranges;
+
     /* We'll store each request line in the trace in this array */
     if ((trace->ops =
          (traceop_t *)malloc(trace->num_ops * sizeof(traceop_t))) == NULL)
@@ -803,41 +1661,23 @@ static trace_t *read_trace(stats_t *stats, const char *tracedir,
          calloc(trace->num_ids, sizeof(*trace->block_rand_base))) == NULL)
         unix_error("malloc 5 failed in read_trace");
 
-
-    /* read every request line in the trace file */
-    index = 0;
-    op_index = 0;
-    while (fscanf(tracefile, "%s", type) != EOF) {
-        switch(type[0]) {
+    /* copy every request of the trace file */
+    for (i = 0; i < trace->num_ops; i++) {
+        switch (rep.ops[i].type) {
         case 'a':
-            fscanf(tracefile, "%u %u", &index, &size);
-            trace->ops[op_index].type = ALLOC;
-            trace->ops[op_index].index = index;
-            trace->ops[op_index].size = size;
-            max_index = (index > max_index) ? index : max_index;
+            trace->ops[i].type = ALLOC;
             break;
         case 'r':
-            fscanf(tracefile, "%u %u", &index, &size);
-            trace->ops[op_index].type = REALLOC;
-            trace->ops[op_index].index = index;
-            trace->ops[op_index].size = size;
-            max_index = (index > max_index) ? index : max_index;
-            break;
-        case 'f':
-            fscanf(tracefile, "%ud", &index);
-            trace->ops[op_index].type = FREE;
-            trace->ops[op_index].index = index;
+            trace->ops[i].type = REALLOC;
             break;
         default:
-            app_error("Bogus type character (%c) in tracefile %s\n",
-                      type[0], trace->filename);
+            trace->ops[i].type = FREE;
+            break;
         }
-        op_index++;
-        if(op_index == trace->num_ops) break;
+        trace->ops[i].index = rep.ops[i].index;
+        trace->ops[i].size = rep.ops[i].size;
     }
-    fclose(tracefile);
-    assert(max_index == trace->num_ids - 1);
-    assert(trace->num_ops == op_index);
+    rep_free(&rep);
 
     /* fill in the stats */
     strcpy(stats->filename, trace->filename);
@@ -876,10 +1716,74 @@ static void free_trace(trace_t *trace)
  **********************************************************************/
 
 /*
- * eval_mm_valid - Check the mm malloc package for correctness
+ * eval_mm_valid - Check the mm malloc package for correctness. Since the
+ *    check replays the whole trace anyway, it also records the heap size
+ *    and the space utilization (see eval_mm_util) of that run in *stats.
+ */
+static int eval_mm_valid(trace_t *trace, range_t **ranges, stats_t *stats)
+{
+    int valid;
+    int max_total_size = 0;
+
+    /* Incremental checking needs to know which heap pages get written */
+    if (debug_mode == DBG_INCREMENTAL)
+        mem_track_writes(1);
+    if (fused_util) {
+        timeline_start(trace);
+        waste_start(trace);
+    }
+    heapmap_start(trace, stats);
+    evlog_on = (evlog_file != NULL);
+    valid = replay_mm_valid(trace, ranges, &max_total_size);
+    evlog_on = 0;
+    mapstats = NULL;
+    mem_track_writes(0);
+    if (fused_util) {
+        timeline_end(stats);
+        waste_end(stats);
+    }
+    if (show_heapstats && valid)
+        pkg->stats(&stats->heap);
+
+    stats->heapsize = mem_heapsize();
+    stats->util = 0;
+    if (valid && stats->heapsize > 0)
+        stats->util = (double)max_total_size / (double)stats->heapsize;
+    if (valid && fused_util)
+        printf(".");
+
+    return valid;
+}
+
+/*
+ * check_fused_util - The utilization recorded by eval_mm_valid is only
+ *    the one eval_mm_util would measure if the mm package lays out the
+ *    heap the same way every time it replays the trace. The timing run
+ *    replayed the same trace from a clean heap, so compare the heap
+ *    sizes and fall back to a utilization pass of its own if they
+ *    differ. The passes time_trace() makes after it (-P, -L, -S, -G)
+ *    leave other heaps behind, so its size is the one saved then.
+ */
+static void check_fused_util(trace_t *trace, stats_t *stats, int tracenum)
+{
+    if (!fused_util || stats->timed_heapsize == stats->heapsize)
+        return;
+
+    if (verbose > 1)
+        printf("Heap size changed between runs of %s (%zu vs %zu bytes), "
+               "measuring utilization separately\n",
+               trace->filename, stats->heapsize, stats->timed_heapsize);
+    stats->util = eval_mm_util(trace, tracenum, stats);
+}
+
+/*
+ * replay_mm_valid - Replay the trace, checking each request as we go and
+ *    keeping track of the high-water mark of the payload bytes
  */
-static int eval_mm_valid(trace_t *trace, range_t **ranges)
+static int replay_mm_valid(trace_t *trace, range_t **ranges,
+                           int *max_total_size)
 {
+    int total_size = 0;
     int i;
     int index;
     size_t size;
@@ -893,10 +1797,11 @@ static int eval_mm_valid(trace_t *trace, range_t **ranges)
     reinit_trace(trace);
 
     /* Call the mm package's init function */
-    if (mm_init() < 0) {
+    if (pkg->init() < 0) {
         malloc_error(trace, 0, "mm_init failed.");
         return 0;
     }
+    heapmap_sample(0);
 
     /* Interpret each operation in the trace in order */
     for (i = 0;  i < trace->num_ops;  i++) {
@@ -907,7 +1812,7 @@ static int eval_mm_valid(trace_t *trace, range_t **ranges)
             range_t *r;
                         
             /* Let the students check their own heap */
-            mm_checkheap(verbose);
+            pkg->checkheap(verbose);
 
             /* Now check that all our allocated blocks have the right data */
             r = *ranges;
@@ -916,13 +1821,26 @@ static int eval_mm_valid(trace_t *trace, range_t **ranges)
                 r = r->next;
             }
         }
+        else if(debug_mode == DBG_INCREMENTAL) {
+            range_t *r;
+
+            pkg->checkheap(verbose);
+
+            /* A block can only have changed if one of its pages was
+               written since the last time we got here */
+            for (r = *ranges; r != NULL; r = r->next) {
+                if (mem_range_dirty(r->lo, r->hi))
+                    check_index(trace, i, r->index);
+            }
+            mem_dirty_reset();
+        }
 
         switch (trace->ops[i].type) {
 
         case ALLOC: /* mm_malloc */
 
             /* Call the student's malloc */
-            if ((p = mm_malloc(size)) == NULL) {
+            if ((p = pkg->malloc(size)) == NULL) {
                 malloc_error(trace, i, "mm_malloc failed.");
                 return 0;
             }
@@ -938,6 +1856,8 @@ static int eval_mm_valid(trace_t *trace, range_t **ranges)
             /* Remember region */
             trace->blocks[index] = p;
             trace->block_sizes[index] = size;
+            total_size += size;
+            waste_update(index, p, size);
 
             /* Set to random data, for debugging. */
             randomize_block(trace, index);
@@ -948,7 +1868,7 @@ static int eval_mm_valid(trace_t *trace, range_t **ranges)
 
             /* Call the student's realloc */
             oldp = trace->blocks[index];
-            newp = mm_realloc(oldp, size);
+            newp = pkg->realloc(oldp, size);
             if( (newp == NULL) && (size != 0) ) {
                 malloc_error(trace, i, "mm_realloc failed.");
                 return 0;
@@ -973,11 +1893,13 @@ static int eval_mm_valid(trace_t *trace, range_t **ranges)
             /* Move the region from where it was.
              * Check up to min(size, oldsize) for correct copying. */
             trace->blocks[index] = newp;
+            total_size += size - trace->block_sizes[index];
             if(size < trace->block_sizes[index]) {
                 trace->block_sizes[index] = size;
             }
             check_index(trace, i, index);
             trace->block_sizes[index] = size;
+            waste_update(index, newp, size);
 
             /* Set to random data, for debugging. */
             randomize_block(trace, index);
@@ -992,14 +1914,23 @@ static int eval_mm_valid(trace_t *trace, range_t **ranges)
             } else {
                 p = trace->blocks[index];
                 remove_range(ranges, p);
+                total_size -= trace->block_sizes[index];
             }
-            mm_free(p);
+            pkg->free(p);
+            waste_update(index, NULL, 0);
             break;
 
         default:
             app_error("Nonexistent request type in eval_mm_valid");
         }
 
+        /* update the high-water mark */
+        if (total_size > *max_total_size)
+            *max_total_size = total_size;
+        if (fused_util)
+            timeline_sample(i, total_size);
+        waste_sample(total_size);
+        heapmap_sample(i + 1);
     }
 
     /* As far as we know, this is a valid malloc package */
@@ -1018,7 +1949,7 @@ static int eval_mm_valid(trace_t *trace, range_t **ranges)
  *
  *   A higher number is better: 1 is optimal.
  */
-static double eval_mm_util(trace_t *trace, int tracenum)
+static double eval_mm_util(trace_t *trace, int tracenum, stats_t *stats)
 {
     int i;
     int index;
@@ -1029,10 +1960,12 @@ static double eval_mm_util(trace_t *trace, int tracenum)
     char *newp, *oldp;
 
     reinit_trace(trace);
+    timeline_start(trace);
+    waste_start(trace);
 
     /* initialize the heap and the mm malloc package */
     mem_reset_brk();
-    if (mm_init() < 0)
+    if (pkg->init() < 0)
         app_error("trace %d: mm_init failed in eval_mm_util", tracenum);
 
     for (i = 0;  i < trace->num_ops;  i++) {
@@ -1042,7 +1975,7 @@ static double eval_mm_util(trace_t *trace, int tracenum)
             index = trace->ops[i].index;
             size = trace->ops[i].size;
 
-            if ((p = mm_malloc(size)) == NULL) {
+            if ((p = pkg->malloc(size)) == NULL) {
                 app_error("trace %d: mm_malloc failed in eval_mm_util",
                           tracenum);
             }
@@ -1050,6 +1983,7 @@ static double eval_mm_util(trace_t *trace, int tracenum)
             /* Remember region and size */
             trace->blocks[index] = p;
             trace->block_sizes[index] = size;
+            waste_update(index, p, size);
 
             total_size += size;
             break;
@@ -1060,7 +1994,7 @@ static double eval_mm_util(trace_t *trace, int tracenum)
             oldsize = trace->block_sizes[index];
 
             oldp = trace->blocks[index];
-            if ((newp = mm_realloc(oldp,newsize)) == NULL && newsize != 0) {
+            if ((newp = pkg->realloc(oldp,newsize)) == NULL && newsize != 0) {
                 app_error("trace %d: mm_realloc failed in eval_mm_util",
                           tracenum);
             }
@@ -1068,6 +2002,7 @@ static double eval_mm_util(trace_t *trace, int tracenum)
             /* Remember region and size */
             trace->blocks[index] = newp;
             trace->block_sizes[index] = newsize;
+            waste_update(index, newp, newsize);
 
             total_size += (newsize - oldsize);
             break;
@@ -1082,7 +2017,8 @@ static double eval_mm_util(trace_t *trace, int tracenum)
                 p = trace->blocks[index];
             }
 
-            mm_free(p);
+            pkg->free(p);
+            waste_update(index, NULL, 0);
 
             total_size -= size;
             break;
@@ -1095,8 +2031,12 @@ static double eval_mm_util(trace_t *trace, int tracenum)
         /* update the high-water mark */
         max_total_size = (total_size > max_total_size) ?
             total_size : max_total_size;
+        timeline_sample(i, total_size);
+        waste_sample(total_size);
     }
 
+    timeline_end(stats);
+    waste_end(stats);
     printf(".");
 
     return ((double)max_total_size / (double)mem_heapsize());
@@ -1109,16 +2049,36 @@ static double eval_mm_util(trace_t *trace, int tracenum)
  */
 static void eval_mm_speed(void *ptr)
 {
-    int i, index, size, newsize;
-    char *p, *newp, *oldp, *block;
     trace_t *trace = ((speed_t *)ptr)->trace;
     reinit_trace(trace);
 
     /* Reset the heap and initialize the mm package */
     mem_reset_brk();
-    if (mm_init() < 0)
+    if (pkg->init() < 0)
         app_error("mm_init failed in eval_mm_speed");
 
+    replay_mm_speed(trace);
+}
+
+/*
+ * The timed loops are written once, for functions passed in, and
+ * always inlined into their callers. Those call them with mm.c's own
+ * functions when it's the package under test, so its requests are
+ * direct calls that -flto (make pgo) can inline, and only the other
+ * packages of -a pay for calls through the allocator table.
+ */
+#define TIMED_LOOP static inline __attribute__((always_inline))
+
+/*
+ * replay_ops - The loop of replay_mm_speed()
+ */
+TIMED_LOOP void replay_ops(trace_t *trace, void *(*malloc_fn)(size_t),
+                           void (*free_fn)(void *),
+                           void *(*realloc_fn)(void *, size_t))
+{
+    int i, index, size, newsize;
+    char *p, *newp, *oldp, *block;
+
     /* Interpret each trace request */
     for (i = 0;  i < trace->num_ops;  i++)
         switch (trace->ops[i].type) {
@@ -1126,7 +2086,7 @@ static void eval_mm_speed(void *ptr)
         case ALLOC: /* mm_malloc */
             index = trace->ops[i].index;
             size = trace->ops[i].size;
-            if ((p = mm_malloc(size)) == NULL)
+            if ((p = malloc_fn(size)) == NULL)
                 app_error("mm_malloc error in eval_mm_speed");
             trace->blocks[index] = p;
             break;
@@ -1135,7 +2095,7 @@ static void eval_mm_speed(void *ptr)
             index = trace->ops[i].index;
             newsize = trace->ops[i].size;
             oldp = trace->blocks[index];
-            if ((newp = mm_realloc(oldp,newsize)) == NULL && newsize != 0)
+            if ((newp = realloc_fn(oldp,newsize)) == NULL && newsize != 0)
                 app_error("mm_realloc error in eval_mm_speed");
             trace->blocks[index] = newp;
             break;
@@ -1147,7 +2107,7 @@ static void eval_mm_speed(void *ptr)
             } else {
                 block = trace->blocks[index];
             }
-            mm_free(block);
+            free_fn(block);
             break;
 
         default:
@@ -1155,6 +2115,176 @@ static void eval_mm_speed(void *ptr)
         }
 }
 
+/*
+ * replay_mm_speed - Run the requests of the trace through the mm
+ *    package, with no checking, on whatever heap it has right now
+ */
+static void replay_mm_speed(trace_t *trace)
+{
+    if (pkg == &allocators[0])
+        replay_ops(trace, mm_malloc, mm_free, mm_realloc);
+    else
+        replay_ops(trace, pkg->malloc, pkg->free, pkg->realloc);
+}
+
+/*
+ * eval_mm_steady - Replay the trace nrounds times back to back on the
+ *    same heap, without calling mm_init in between. Blocks the trace
+ *    leaves allocated are freed after each round, so every round starts
+ *    with an empty but fragmented heap. Each round is timed on its own,
+ *    and its utilization is the peak payload of the trace over the heap
+ *    size so far (the heap never shrinks).
+ */
+static void eval_mm_steady(trace_t *trace, round_t *rounds, int nrounds)
+{
+    int i, r, index;
+    int total_size = 0, max_total_size = 0;
+    char *left;
+    unsigned long long t0, t1;
+    double ticks_per_sec = mhz(0) * 1e6;
+
+    /* Find the peak payload, and which blocks the trace doesn't free */
+    if ((left = calloc(trace->num_ids, 1)) == NULL)
+        unix_error("calloc failed in eval_mm_steady");
+    reinit_trace(trace);
+    for (i = 0;  i < trace->num_ops;  i++) {
+        index = trace->ops[i].index;
+        if (index < 0)
+            continue;
+        total_size -= trace->block_sizes[index];
+        if (trace->ops[i].type == FREE) {
+            trace->block_sizes[index] = 0;
+            left[index] = 0;
+        } else {
+            trace->block_sizes[index] = trace->ops[i].size;
+            left[index] = (trace->ops[i].size > 0);
+        }
+        total_size += trace->block_sizes[index];
+        if (total_size > max_total_size)
+            max_total_size = total_size;
+    }
+
+    mem_reset_brk();
+    if (pkg->init() < 0)
+        app_error("mm_init failed in eval_mm_steady");
+
+    for (r = 0; r < nrounds; r++) {
+        reinit_trace(trace);
+        t0 = read_counter();
+        replay_mm_speed(trace);
+        t1 = read_counter();
+
+        for (index = 0; index < trace->num_ids; index++) {
+            if (left[index])
+                pkg->free(trace->blocks[index]);
+        }
+
+        rounds[r].secs = (t1 - t0) / ticks_per_sec;
+        rounds[r].heapsize = mem_heapsize();
+        rounds[r].util = (rounds[r].heapsize > 0) ?
+            (double)max_total_size / rounds[r].heapsize : 0;
+    }
+    free(left);
+}
+
+/*
+ * counter_overhead - Smallest number of ticks between two back-to-back
+ *    reads of the counter, i.e. what an empty timed region costs
+ */
+static unsigned long long counter_overhead(void)
+{
+    unsigned long long t0, t1, best = ~0ULL;
+    int i;
+
+    for (i = 0; i < 1000; i++) {
+        t0 = read_counter();
+        t1 = read_counter();
+        if (t1 - t0 < best)
+            best = t1 - t0;
+    }
+    return best;
+}
+
+/*
+ * latency_ops - The loop of eval_mm_latency()
+ */
+TIMED_LOOP void latency_ops(trace_t *trace, lathist_t *lat,
+                            unsigned long long ovhd,
+                            void *(*malloc_fn)(size_t),
+                            void (*free_fn)(void *),
+                            void *(*realloc_fn)(void *, size_t))
+{
+    int i, index, size;
+    char *p, *oldp;
+    unsigned long long t0, t1;
+
+    for (i = 0;  i < trace->num_ops;  i++) {
+        index = trace->ops[i].index;
+        size = trace->ops[i].size;
+
+        switch (trace->ops[i].type) {
+
+        case ALLOC: /* mm_malloc */
+            t0 = read_counter();
+            p = malloc_fn(size);
+            t1 = read_counter();
+            if (p == NULL)
+                app_error("mm_malloc error in eval_mm_latency");
+            trace->blocks[index] = p;
+            break;
+
+        case REALLOC: /* mm_realloc */
+            oldp = trace->blocks[index];
+            t0 = read_counter();
+            p = realloc_fn(oldp, size);
+            t1 = read_counter();
+            if (p == NULL && size != 0)
+                app_error("mm_realloc error in eval_mm_latency");
+            trace->blocks[index] = p;
+            break;
+
+        case FREE: /* mm_free */
+            p = (index < 0) ? NULL : trace->blocks[index];
+            t0 = read_counter();
+            free_fn(p);
+            t1 = read_counter();
+            break;
+
+        default:
+            app_error("Nonexistent request type in eval_mm_latency");
+        }
+
+        lathist_add(&lat[trace->ops[i].type],
+                    (t1 - t0 > ovhd) ? t1 - t0 - ovhd : 0);
+    }
+}
+
+/*
+ * eval_mm_latency - Replay the trace once, timing each call into the mm
+ *    package on its own. The counter's own overhead is subtracted and
+ *    the result is recorded in the histogram for the request's type.
+ */
+static void eval_mm_latency(trace_t *trace, lathist_t *lat)
+{
+    int i;
+    unsigned long long ovhd;
+
+    for (i = 0; i < NUM_OPTYPES; i++)
+        lathist_init(&lat[i]);
+    ovhd = counter_overhead();
+    reinit_trace(trace);
+
+    /* Reset the heap and initialize the mm package */
+    mem_reset_brk();
+    if (pkg->init() < 0)
+        app_error("mm_init failed in eval_mm_latency");
+
+    if (pkg == &allocators[0])
+        latency_ops(trace, lat, ovhd, mm_malloc, mm_free, mm_realloc);
+    else
+        latency_ops(trace, lat, ovhd, pkg->malloc, pkg->free, pkg->realloc);
+}
+
 /*
  * eval_libc_valid - We run this function to make sure that the
  *    libc malloc can run to completion on the set of traces.
@@ -1383,6 +2513,749 @@ static void printresults(int n, stats_t *stats, sum_stats_t *sumstats)
     }
 }
 
+/*
+ * printevents - prints the event counts per operation for each trace,
+ *               followed by the per-operation average over all traces
+ */
+static void printevents(int n, stats_t *stats)
+{
+    int i, j;
+    int ncols = 0;
+    const perfctr_t *names = NULL;
+    double total[PERFCTR_MAX] = {0};
+    double totalops = 0;
+
+    for (i = 0; i < n; i++) {
+        if (stats[i].valid && stats[i].perf.n > 0) {
+            names = &stats[i].perf;
+            ncols = names->n;
+            break;
+        }
+    }
+    if (names == NULL)
+        return;
+
+    printf("\nEvents per operation:\n");
+    for (j = 0; j < ncols; j++)
+        printf("%10s", names->name[j]);
+    printf("  %s\n", "trace");
+
+    for (i = 0; i < n; i++) {
+        if (!stats[i].valid || stats[i].perf.n != ncols)
+            continue;
+        for (j = 0; j < ncols; j++) {
+            printf("%10.2f", stats[i].perf.value[j] / stats[i].ops);
+            total[j] += stats[i].perf.value[j];
+        }
+        totalops += stats[i].ops;
+        printf("  %s\n", stats[i].filename);
+    }
+
+    for (j = 0; j < ncols; j++)
+        printf("%10.2f", totalops == 0 ? 0 : total[j] / totalops);
+    printf("  %s\n", "(all traces)");
+}
+
+/*
+ * printlatency - prints the latency percentiles of each request type for
+ *                each trace, and over all traces, in nanoseconds
+ */
+static void printlatency(int n, stats_t *stats)
+{
+    static const char *opname[NUM_OPTYPES] = { "malloc", "free", "realloc" };
+    static lathist_t all[NUM_OPTYPES];
+    double ns = 1e3 / mhz(0); /* nanoseconds per counter tick */
+    int i, t;
+
+    printf("\nLatency per request (ns):\n");
+    printf("  %-8s%9s%8s%8s%8s%10s  %s\n",
+           "op", "count", "p50", "p99", "p99.9", "max", "trace");
+
+    for (t = 0; t < NUM_OPTYPES; t++)
+        lathist_init(&all[t]);
+
+    for (i = 0; i <= n; i++) {
+        const lathist_t *lat;
+
+        if (i < n) {
+            if (!stats[i].valid || stats[i].lat == NULL)
+                continue;
+            lat = stats[i].lat;
+        } else {
+            lat = all;
+        }
+
+        for (t = 0; t < NUM_OPTYPES; t++) {
+            if (lat[t].n == 0)
+                continue;
+            printf("  %-8s%9llu%8.0f%8.0f%8.0f%10.0f  %s\n",
+                   opname[t], lat[t].n,
+                   lathist_percentile(&lat[t], 50.0) * ns,
+                   lathist_percentile(&lat[t], 99.0) * ns,
+                   lathist_percentile(&lat[t], 99.9) * ns,
+                   lat[t].max * ns,
+                   i < n ? stats[i].filename : "(all traces)");
+            if (i < n)
+                lathist_merge(&all[t], &lat[t]);
+        }
+    }
+}
+
+/*
+ * printtimeline - prints the summary of the sampled footprint next to
+ *                 the utilization of each trace
+ */
+static void printtimeline(int n, stats_t *stats)
+{
+    int i;
+
+    printf("\nFootprint sampled every %d requests:\n", timeline_every);
+    printf("  %6s%10s%12s  %s\n", "util", "avg util", "worst frag", "trace");
+    for (i = 0; i < n; i++) {
+        if (!stats[i].valid)
+            continue;
+        printf("  %5.0f%%%9.0f%%%11.0f%%  %s\n",
+               stats[i].util * 100.0, stats[i].avg_util * 100.0,
+               stats[i].worst_frag * 100.0, stats[i].filename);
+    }
+}
+
+/*
+ * printwaste - prints where the heap went at the payload peak of each
+ *              trace, as percentages of the final heap
+ */
+static void printwaste(int n, stats_t *stats)
+{
+    int i;
+    double heap;
+    const waste_t *w;
+
+    printf("\nHeap at the payload peak, %% of the final heap:\n");
+    printf("  %6s%8s%10s%9s%7s%8s  %s\n", "util", "header", "rounding",
+           "unsplit", "free", "growth", "trace");
+    for (i = 0; i < n; i++) {
+        w = &stats[i].waste;
+        heap = (double)(w->live + w->header + w->rounding + w->unsplit +
+                        w->freelist + w->growth);
+        if (!stats[i].valid || heap == 0)
+            continue;
+        printf("  %5.1f%%%7.1f%%%9.1f%%%8.1f%%%6.1f%%%7.1f%%  %s\n",
+               100.0 * w->live / heap, 100.0 * w->header / heap,
+               100.0 * w->rounding / heap, 100.0 * w->unsplit / heap,
+               100.0 * w->freelist / heap, 100.0 * w->growth / heap,
+               stats[i].filename);
+    }
+}
+
+/*
+ * printsteady - prints the throughput and utilization of each round of
+ *               the steady-state runs, per trace and over all traces
+ */
+static void printsteady(int n, stats_t *stats)
+{
+    int i, r;
+    double ops, secs, util;
+    int ntraces;
+
+    printf("\nSteady state over %d rounds on the same heap:\n",
+           steady_rounds);
+    printf("  %5s%10s%7s%12s  %s\n", "round", "Kops", "util", "heap",
+           "trace");
+    for (i = 0; i < n; i++) {
+        if (!stats[i].valid || stats[i].rounds == NULL)
+            continue;
+        for (r = 0; r < steady_rounds; r++) {
+            const round_t *round = &stats[i].rounds[r];
+            printf("  %5d%10.0f%6.0f%%%12zu  %s\n", r + 1,
+                   round->secs > 0 ? stats[i].ops / (round->secs * 1e3) : 0,
+                   round->util * 100.0, round->heapsize, stats[i].filename);
+        }
+    }
+
+    for (r = 0; r < steady_rounds; r++) {
+        ops = secs = util = 0;
+        ntraces = 0;
+        for (i = 0; i < n; i++) {
+            if (!stats[i].valid || stats[i].rounds == NULL)
+                continue;
+            ops += stats[i].ops;
+            secs += stats[i].rounds[r].secs;
+            util += stats[i].rounds[r].util;
+            ntraces++;
+        }
+        if (ntraces == 0)
+            break;
+        printf("  %5d%10.0f%6.0f%%%12s  %s\n", r + 1,
+               secs > 0 ? ops / (secs * 1e3) : 0,
+               util / ntraces * 100.0, "", "(all traces)");
+    }
+}
+
+/*
+ * printheapstats - prints the mm package's own counters at the end of
+ *                  the correctness check of each trace, followed by the
+ *                  free blocks in each of its lists
+ */
+static void printheapstats(int n, stats_t *stats)
+{
+    int i, c;
+    const mm_stats_t *h;
+
+    printf("\nStatistics of the mm package at the end of each trace:\n");
+    printf("  %10s%10s%10s%10s%7s%8s%10s  %s\n", "heap", "alloc", "free",
+           "largest", "sbrks", "splits", "coalesces", "trace");
+    for (i = 0; i < n; i++) {
+        h = &stats[i].heap;
+        if (!stats[i].valid)
+            continue;
+        printf("  %10zu%10zu%10zu%10zu%7lu%8lu%10lu  %s\n", h->heapsize,
+               h->alloc_bytes, h->free_bytes, h->largest_free, h->sbrk_calls,
+               h->splits, h->coalesces, stats[i].filename);
+        if (h->free_bytes == 0)
+            continue;
+        printf("  %10s", "lists:");
+        for (c = 0; c < h->nclasses; c++)
+            if (h->class_blocks[c] > 0)
+                printf(" %d:%zu/%zu", c, h->class_blocks[c], h->class_bytes[c]);
+        printf("\n");
+    }
+}
+
+#ifdef MM_INSTRUMENT
+/*
+ * printinstr - prints what the instrumented mm.c recorded over one run
+ *              of each trace: the cycles spent in each phase, how long
+ *              find_fit searched, which list served each request, and
+ *              how often each case of coalesce() came up
+ */
+static void printinstr(int n, stats_t *stats)
+{
+    static const char *phases[MM_NPHASES] = {
+        "find_fit", "place", "coalesce", "extend_heap"
+    };
+    int i, k;
+    unsigned long searches;
+    unsigned long long total;
+    const mm_instr_t *m;
+
+    printf("\nInstrumentation of mm.c, over one run of each trace:\n");
+    for (i = 0; i < n; i++) {
+        m = &stats[i].instr;
+        if (!stats[i].valid)
+            continue;
+        printf("%s\n", stats[i].filename);
+
+        total = 0;
+        for (k = 0; k < MM_NPHASES; k++)
+            total += m->cycles[k];
+        printf("  %-12s%10s%12s%7s\n", "phase", "calls", "cycles/call",
+               "share");
+        for (k = 0; k < MM_NPHASES; k++)
+            printf("  %-12s%10lu%12.1f%6.1f%%\n", phases[k], m->calls[k],
+                   m->calls[k] ? (double)m->cycles[k] / m->calls[k] : 0.0,
+                   total ? 100.0 * m->cycles[k] / total : 0.0);
+
+        searches = 0;
+        for (k = 0; k < MM_SEARCH_BUCKETS; k++)
+            searches += m->search_hist[k];
+        printf("  nodes visited per search (mean %.1f):",
+               searches ? (double)m->nodes / searches : 0.0);
+        for (k = 0; k < MM_SEARCH_BUCKETS; k++) {
+            if (m->search_hist[k] == 0)
+                continue;
+            if (k <= 1)
+                printf(" %d:%lu", k, m->search_hist[k]);
+            else
+                printf(" %lu-%lu:%lu", 1UL << (k - 1), (1UL << k) - 1,
+                       m->search_hist[k]);
+        }
+        printf("\n  requests served by list:");
+        for (k = 0; k < MM_MAXCLASSES; k++)
+            if (m->class_served[k] > 0)
+                printf(" %d:%lu", k, m->class_served[k]);
+        printf(" heap:%lu\n", m->heap_served);
+        printf("  coalesce cases 1-4: %lu %lu %lu %lu, splits: %lu of %lu places\n",
+               m->coalesce_case[0], m->coalesce_case[1], m->coalesce_case[2],
+               m->coalesce_case[3], m->splits, m->calls[MM_PLACE]);
+    }
+}
+#endif
+
+/*
+ * free_trace_stats - frees the per-trace buffers of the latency (-L) and
+ *                    steady-state (-S) measurements once they're printed
+ */
+static void free_trace_stats(int n, stats_t *stats)
+{
+    int i;
+
+    for (i = 0; i < n; i++) {
+        free(stats[i].lat);
+        stats[i].lat = NULL;
+        free(stats[i].rounds);
+        stats[i].rounds = NULL;
+    }
+}
+
+/*
+ * printhugepages - prints the throughput of each trace with the heap on
+ *     normal and on huge pages, and the TLB misses per request of both
+ *     if we can count them (page faults, if that's all we have)
+ */
+static void printhugepages(int n, stats_t *stats)
+{
+    static const char *events[] = { "dTLB-miss", "pg-fault", "minflt" };
+    const stats_t *first = NULL;
+    int i, j, k, ev = -1;
+    double secs = 0, huge_secs = 0, ops = 0;
+    double count = 0, huge_count = 0;
+
+    for (i = 0; i < n && first == NULL; i++)
+        if (stats[i].valid)
+            first = &stats[i];
+    if (first == NULL)
+        return;
+    for (k = 0; k < 3 && ev < 0; k++)
+        for (j = 0; j < first->perf.n && ev < 0; j++)
+            if (strcmp(first->perf.name[j], events[k]) == 0)
+                ev = j;
+
+    printf("\nHeap on huge pages (%s), against normal pages:\n",
+           first->huge_mode);
+    printf("%9s%10s%8s%12s%12s%10s  %s\n", "Kops", "huge Kops", "change",
+           ev >= 0 ? first->perf.name[ev] : "-", "huge", "huge MB", "trace");
+    for (i = 0; i < n; i++) {
+        const stats_t *s = &stats[i];
+
+        if (!s->valid || s->secs <= 0 || s->huge_secs <= 0)
+            continue;
+        printf("%9.0f%10.0f%7.1f%%", s->ops / 1e3 / s->secs,
+               s->ops / 1e3 / s->huge_secs, (s->secs / s->huge_secs - 1) * 100);
+        if (ev >= 0 && s->perf.n > ev && s->huge_perf.n > ev) {
+            printf("%12.3f%12.3f", s->perf.value[ev] / s->ops,
+                   s->huge_perf.value[ev] / s->ops);
+            count += s->perf.value[ev];
+            huge_count += s->huge_perf.value[ev];
+        } else
+            printf("%12s%12s", "-", "-");
+        printf("%10.1f  %s\n", s->huge_bytes / 1048576.0, s->filename);
+        secs += s->secs;
+        huge_secs += s->huge_secs;
+        ops += s->ops;
+    }
+    if (secs > 0 && huge_secs > 0) {
+        printf("%9.0f%10.0f%7.1f%%", ops / 1e3 / secs, ops / 1e3 / huge_secs,
+               (secs / huge_secs - 1) * 100);
+        if (ev >= 0)
+            printf("%12.3f%12.3f", count / ops, huge_count / ops);
+        else
+            printf("%12s%12s", "-", "-");
+        printf("%10s  %s\n", "", "(all traces)");
+    }
+}
+
+/*
+ * printheapmaps - prints the free space at each heap map of each trace
+ */
+static void printheapmaps(int n, stats_t *stats)
+{
+    int i, k;
+    const heapmap_t *m;
+
+    printf("\nFree space at each heap map (<trace>.<op>.pgm):\n");
+    printf("  %8s%10s%8s%10s%12s%10s  %s\n", "op", "heap", "blocks",
+           "free", "longest run", "avg free", "trace");
+    for (i = 0; i < n; i++) {
+        if (!stats[i].valid)
+            continue;
+        for (k = 0; k < stats[i].nmaps; k++) {
+            m = &stats[i].maps[k];
+            printf("  %8d%10zu%8zu%10zu%12zu%10.0f  %s\n", m->opnum,
+                   m->heapsize, m->free_blocks, m->free_bytes,
+                   m->longest_run, m->free_blocks ?
+                   (double)m->free_bytes / m->free_blocks : 0.0,
+                   stats[i].filename);
+        }
+    }
+}
+
+/*
+ * printcompare - prints the utilization and the throughput of each
+ *                package side by side, one trace per line. libc only
+ *                gets a throughput column, as we cannot see its heap.
+ */
+static void printcompare(int n, int npkgs, const allocator_t **pkgs,
+                         stats_t **stats, stats_t *libc_stats)
+{
+    int i, j, k;
+    double util, ops, secs;
+    int ntraces;
+    const stats_t *s;
+
+    printf("\nUtilization side by side:\n ");
+    for (k = 0; k < npkgs; k++)
+        printf("%10s", pkgs[k]->name);
+    printf("  trace\n");
+    for (i = 0; i < n; i++) {
+        printf(" ");
+        for (k = 0; k < npkgs; k++) {
+            s = &stats[k][i];
+            if (s->valid && s->weight != WPERF)
+                printf("%9.0f%%", s->util * 100.0);
+            else
+                printf("%10s", "--");
+        }
+        printf("  %s\n", stats[0][i].filename);
+    }
+    printf(" ");
+    for (k = 0; k < npkgs; k++) {
+        util = 0;
+        ntraces = 0;
+        for (i = 0; i < n; i++) {
+            s = &stats[k][i];
+            if (s->valid && (s->weight == WALL || s->weight == WUTIL)) {
+                util += s->util;
+                ntraces++;
+            }
+        }
+        if (ntraces > 0)
+            printf("%9.0f%%", util / ntraces * 100.0);
+        else
+            printf("%10s", "--");
+    }
+    printf("  (all traces)\n");
+
+    printf("\nKops side by side:\n ");
+    for (k = 0; k <= npkgs; k++)
+        if (k < npkgs || libc_stats != NULL)
+            printf("%10s", k < npkgs ? pkgs[k]->name : "libc");
+    printf("  trace\n");
+    for (i = 0; i <= n; i++) {
+        printf(" ");
+        for (k = 0; k <= npkgs; k++) {
+            if (k == npkgs && libc_stats == NULL)
+                break;
+            if (i < n) {
+                s = k < npkgs ? &stats[k][i] : &libc_stats[i];
+                ops = s->ops;
+                secs = (s->valid && s->weight != WUTIL) ? s->secs : 0;
+            } else {
+                /* Like the index, the total is ops over secs of the
+                   traces that count for throughput */
+                ops = secs = 0;
+                for (j = 0; j < n; j++) {
+                    s = k < npkgs ? &stats[k][j] : &libc_stats[j];
+                    if (s->valid && (s->weight == WALL || s->weight == WPERF)) {
+                        ops += s->ops;
+                        secs += s->secs;
+                    }
+                }
+            }
+            if (secs > 0)
+                printf("%10.0f", ops / (secs * 1e3));
+            else
+                printf("%10s", "--");
+        }
+        printf("  %s\n", i < n ? stats[0][i].filename : "(all traces)");
+    }
+}
+
+/*
+ * is_csv - does filename name a CSV report (as opposed to JSON)?
+ */
+static int is_csv(const char *filename)
+{
+    size_t len = strlen(filename);
+
+    return len >= 4 && strcmp(filename + len - 4, ".csv") == 0;
+}
+
+/*
+ * timing_samples - finds the best and worst of the positive samples of
+ *     s, and returns how many there are. On a trace too short to time,
+ *     fsecs() can come out at zero or below, which says nothing.
+ */
+static int timing_samples(const stats_t *s, double *best, double *worst)
+{
+    int i, n = 0;
+
+    *best = *worst = 0;
+    for (i = 0; i < s->nsamples; i++) {
+        if (s->samples[i] <= 0)
+            continue;
+        if (n == 0 || s->samples[i] < *best)
+            *best = s->samples[i];
+        if (n == 0 || s->samples[i] > *worst)
+            *worst = s->samples[i];
+        n++;
+    }
+    return n;
+}
+
+/*
+ * report_secs - the time to report for trace s: its measured secs, or
+ *     its best positive sample if that came out nonpositive, or 0 if
+ *     it has none
+ */
+static double report_secs(const stats_t *s)
+{
+    double best, worst;
+
+    if (s->secs > 0)
+        return s->secs;
+    return timing_samples(s, &best, &worst) > 0 ? best : 0;
+}
+
+/*
+ * write_report - saves the results for each trace and the performance
+ *                index in filename, as CSV if its name ends in ".csv" and
+ *                as JSON otherwise. Every trace goes on a line of its own,
+ *                which is what read_report() relies on.
+ */
+static void write_report(const char *filename, int n, stats_t *stats,
+                         double util, double tput, double perfindex)
+{
+    FILE *fp;
+    int i, j;
+    int csv = is_csv(filename);
+
+    if ((fp = fopen(filename, "w")) == NULL)
+        unix_error("Could not open %s in write_report", filename);
+
+    if (csv)
+        fprintf(fp, "trace,valid,weight,util,ops,secs,kops,perfindex,samples\n");
+    else
+        fprintf(fp, "{\n  \"perfindex\": %.2f,\n  \"util\": %.6f,\n"
+                "  \"kops\": %.0f,\n  \"traces\": [\n",
+                perfindex, util, tput / 1e3);
+
+    for (i = 0; i < n; i++) {
+        double secs = report_secs(&stats[i]);
+        double kops = (stats[i].valid && secs > 0) ?
+            (stats[i].ops / 1e3) / secs : 0;
+        int first = 1;
+
+        if (csv)
+            fprintf(fp, "%s,%d,%d,%.6f,%.0f,%.9f,%.0f,,",
+                    stats[i].filename, stats[i].valid, stats[i].weight,
+                    stats[i].util, stats[i].ops, secs, kops);
+        else
+            fprintf(fp, "    {\"trace\": \"%s\", \"valid\": %d, \"weight\": %d, "
+                    "\"util\": %.6f, \"ops\": %.0f, \"secs\": %.9f, "
+                    "\"kops\": %.0f, \"samples\": [",
+                    stats[i].filename, stats[i].valid, stats[i].weight,
+                    stats[i].util, stats[i].ops, secs, kops);
+
+        /* Only the positive samples; see timing_samples() */
+        for (j = 0; j < stats[i].nsamples; j++) {
+            if (stats[i].samples[j] <= 0)
+                continue;
+            fprintf(fp, "%s%.9f", first ? "" : (csv ? ";" : ", "),
+                    stats[i].samples[j]);
+            first = 0;
+        }
+
+        if (csv)
+            fprintf(fp, "\n");
+        else
+            fprintf(fp, "]}%s\n", i < n - 1 ? "," : "");
+    }
+
+    if (csv)
+        fprintf(fp, "(all),,,%.6f,,,%.0f,%.2f,\n", util, tput / 1e3, perfindex);
+    else
+        fprintf(fp, "  ]\n}\n");
+    fclose(fp);
+}
+
+/*
+ * report_field - returns a pointer to the value of field key on a line
+ *                of a report, or NULL if the line doesn't have it. For CSV
+ *                lines, key is the column number.
+ */
+static const char *report_field(const char *line, int csv, const char *key,
+                                int column)
+{
+    char pattern[MAXLINE];
+    const char *p;
+
+    if (csv) {
+        for (p = line; column > 0; column--) {
+            if ((p = strchr(p, ',')) == NULL)
+                return NULL;
+            p++;
+        }
+        return p;
+    }
+
+    sprintf(pattern, "\"%s\":", key);
+    if ((p = strstr(line, pattern)) == NULL)
+        return NULL;
+    p += strlen(pattern);
+    while (*p == ' ' || *p == '"' || *p == '[')
+        p++;
+    return p;
+}
+
+/*
+ * read_report - reads the per-trace results back from a report written
+ *               by write_report(). Returns an array of *n stats records.
+ */
+static stats_t *read_report(const char *filename, int *n)
+{
+    FILE *fp;
+    char line[4 * MAXLINE];
+    stats_t *stats = NULL;
+    int csv = is_csv(filename);
+    const char *p;
+
+    if ((fp = fopen(filename, "r")) == NULL)
+        unix_error("Could not open baseline %s", filename);
+
+    *n = 0;
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        stats_t *s;
+        size_t len;
+
+        /* Only the lines that describe a trace are of interest */
+        if (csv ? (strncmp(line, "trace,", 6) == 0 ||
+                   strncmp(line, "(all),", 6) == 0)
+                : strstr(line, "\"trace\":") == NULL)
+            continue;
+
+        if ((stats = realloc(stats, (*n + 1) * sizeof(stats_t))) == NULL)
+            unix_error("realloc failed in read_report");
+        s = &stats[(*n)++];
+        memset(s, 0, sizeof(*s));
+
+        p = report_field(line, csv, "trace", 0);
+        len = strcspn(p, csv ? "," : "\"");
+        if (len >= MAXLINE)
+            len = MAXLINE - 1;
+        memcpy(s->filename, p, len);
+        s->filename[len] = '\0';
+
+        if ((p = report_field(line, csv, "valid", 1)) != NULL)
+            s->valid = atoi(p);
+        if ((p = report_field(line, csv, "weight", 2)) != NULL)
+            s->weight = atoi(p);
+        if ((p = report_field(line, csv, "util", 3)) != NULL)
+            s->util = atof(p);
+        if ((p = report_field(line, csv, "ops", 4)) != NULL)
+            s->ops = atof(p);
+        if ((p = report_field(line, csv, "secs", 5)) != NULL)
+            s->secs = atof(p);
+
+        /* The samples are separated by ";" in CSV and ", " in JSON */
+        p = report_field(line, csv, "samples", 8);
+        while (p != NULL && s->nsamples < FSECS_MAXSAMPLES &&
+               ((*p >= '0' && *p <= '9') || *p == '.')) {
+            s->samples[s->nsamples++] = atof(p);
+            p += strcspn(p, csv ? ";\n" : ",]");
+            while (*p == ';' || *p == ',' || *p == ' ')
+                p++;
+        }
+        if (s->nsamples == 0 && s->secs > 0)
+            s->samples[s->nsamples++] = s->secs;
+    }
+    fclose(fp);
+
+    if (*n == 0)
+        app_error("No trace results found in baseline %s\n", filename);
+    return stats;
+}
+
+/*
+ * trace_basename - the name of a trace without its directory
+ */
+static const char *trace_basename(const char *filename)
+{
+    const char *slash = strrchr(filename, '/');
+
+    return slash != NULL ? slash + 1 : filename;
+}
+
+/*
+ * compare_baseline - compares the results with the baseline report in
+ *     filename and prints a table of the differences. A trace is flagged
+ *     if it stopped being valid, if its utilization dropped, or if its
+ *     best sample is slower than the baseline's worst by more than
+ *     BASELINE_TOL. A trace without a positive timing sample in either
+ *     run can't be compared for speed, and is marked n/a rather than
+ *     flagged. Returns the number of flagged traces.
+ */
+static int compare_baseline(const char *filename, int n, stats_t *stats)
+{
+    stats_t *base;
+    int nbase, i, j;
+    int regressions = 0;
+
+    base = read_report(filename, &nbase);
+
+    printf("\nComparison with baseline %s:\n", filename);
+    printf("  %9s%9s%8s%10s%7s  %-8s %s\n",
+           "base Kops", "Kops", "change", "base util", "util", "result", "trace");
+
+    for (i = 0; i < n; i++) {
+        const stats_t *b = NULL;
+        const stats_t *s = &stats[i];
+        const char *result = "ok";
+
+        for (j = 0; j < nbase; j++) {
+            if (strcmp(trace_basename(base[j].filename),
+                       trace_basename(s->filename)) == 0) {
+                b = &base[j];
+                break;
+            }
+        }
+        if (b == NULL) {
+            printf("  %9s%9s%8s%10s%7s  %-8s %s\n",
+                   "-", "-", "-", "-", "-", "new", s->filename);
+            continue;
+        }
+
+        if (b->valid && !s->valid) {
+            result = "INVALID";
+        } else if (b->valid && s->valid) {
+            /* The K best samples of each run are within a few percent of
+               each other, so only non-overlapping sets mean anything */
+            double best, worst, base_best, base_worst;
+            int timed = timing_samples(s, &best, &worst) > 0 &&
+                timing_samples(b, &base_best, &base_worst) > 0;
+
+            if (s->weight != WPERF && s->util < b->util - BASELINE_UTIL_TOL)
+                result = "UTIL";
+            else if (s->weight != WUTIL && !timed)
+                result = "n/a";
+            else if (s->weight != WUTIL && best > base_worst * (1 + BASELINE_TOL))
+                result = "SLOWER";
+            else if (s->weight != WUTIL && worst * (1 + BASELINE_TOL) < base_best)
+                result = "faster";
+        }
+        if (strcmp(result, "ok") != 0 && strcmp(result, "faster") != 0 &&
+            strcmp(result, "n/a") != 0)
+            regressions++;
+
+        if (b->valid && s->valid && report_secs(b) > 0 && report_secs(s) > 0)
+            printf("  %9.0f%9.0f%7.1f%%%9.0f%%%6.0f%%  %-8s %s\n",
+                   (b->ops / 1e3) / report_secs(b),
+                   (s->ops / 1e3) / report_secs(s),
+                   (report_secs(b) / report_secs(s) - 1) * 100.0,
+                   b->util * 100.0, s->util * 100.0, result, s->filename);
+        else
+            printf("  %9s%9s%8s%10s%7s  %-8s %s\n",
+                   "-", "-", "-", "-", "-", result, s->filename);
+    }
+
+    if (regressions > 0)
+        printf("%d trace(s) regressed against the baseline\n", regressions);
+    else
+        printf("No regressions against the baseline\n");
+
+    free(base);
+    return regressions;
+}
+
 /*
  * app_error - Report an arbitrary application error
  */
@@ -1428,17 +3301,34 @@ void malloc_error(const trace_t *trace, int opnum, const char *fmt, ...)
  */
 static void usage(void)
 {
-    fprintf(stderr, "Usage: mdriver [-hlVdD] [-f <file>]\n");
+    fprintf(stderr, "Usage: mdriver [-hlVdDPLuFMG] [-a <list>] [-j <n>] [-E <file>] [-H <n,...>] [-C <name>=<value>] [-S <n>] [-T <n>] [-x <n>] [-f <file>] [-o <report>] [-b <baseline>]\n");
     fprintf(stderr, "Options\n");
     fprintf(stderr, "\t-p         Calculate Checkpoint Score.\n");
-    fprintf(stderr, "\t-d <i>     Debug: 0 off; 1 default; 2 lots.\n");
+    fprintf(stderr, "\t-d <i>     Debug: 0 off; 1 default; 2 lots; 3 lots, incremental.\n");
     fprintf(stderr, "\t-D         Equivalent to -d2.\n");
     fprintf(stderr, "\t-c <file>  Run trace file <file> once, check for correctness only.\n");
     fprintf(stderr, "\t-t <dir>   Directory to find default traces.\n");
     fprintf(stderr, "\t-h         Print this message.\n");
     fprintf(stderr, "\t-l         Run libc malloc as well.\n");
+    fprintf(stderr, "\t-a <list>  Run the comma-separated packages (mm, textbook, naive, libc,\n");
+    fprintf(stderr, "\t           all) side by side; the first one is scored.\n");
     fprintf(stderr, "\t-V         Print diagnostics as each trace is run.\n");
     fprintf(stderr, "\t-v <i>     Set Verbosity Level to <i>\n");
     fprintf(stderr, "\t-s <s>     Timeout after s secs (default no timeout)\n");
+    fprintf(stderr, "\t-P         Count hardware events (instructions, misses, ...) per op.\n");
+    fprintf(stderr, "\t-L         Report latency percentiles of malloc, free and realloc.\n");
+    fprintf(stderr, "\t-F         Break down the wasted space at the peak of each trace.\n");
+    fprintf(stderr, "\t-H <n,...> Write heap maps <trace>.<n>.pgm after <n> requests; measure free runs.\n");
+    fprintf(stderr, "\t-M         Print the mm package's own statistics (mm_stats) for each trace.\n");
+    fprintf(stderr, "\t-G         Time each trace again on a heap of 2 MiB pages and compare.\n");
+    fprintf(stderr, "\t-S <n>     Also replay each trace <n> times on the same heap, without mm_init.\n");
+    fprintf(stderr, "\t-C <n>=<v> Set parameter <n> of mm.c to <v> (see mm_setparam).\n");
+    fprintf(stderr, "\t-x <n>     Scale each trace up to <n> interleaved copies of itself.\n");
+    fprintf(stderr, "\t-T <n>     Sample the footprint every <n> requests into <trace>.timeline.csv.\n");
+    fprintf(stderr, "\t-u         Measure utilization in a separate pass, not while checking.\n");
+    fprintf(stderr, "\t-j <n>     Check traces in <n> parallel processes (0: one per CPU).\n");
+    fprintf(stderr, "\t-E <file>  Log the requests of mm.c's correctness checks in <file> (see evdump).\n");
+    fprintf(stderr, "\t-o <file>  Save the results in <file> (CSV if it ends in .csv, else JSON).\n");
+    fprintf(stderr, "\t-b <file>  Compare the results with the report in <file>; exit 2 on regressions.\n");
     fprintf(stderr, "\t-f <file>  Use <file> as the trace file.\n");
 }
@@ -12,6 +12,8 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <signal.h>
+#include <stdint.h>
 
 #include "memlib.h"
 #include "config.h"
@@ -20,19 +22,109 @@
 static char *heap;
 static char *mem_brk;
 static char *mem_max_addr;
+static size_t max_heap = MAX_HEAP;	/* size of the heap's mapping */
+static size_t map_size;				/* bytes mapped by the last mem_init */
+
+/* huge page state, see mem_set_hugepages() */
+#define HUGEPAGE_SIZE (2UL << 20)
+static int hugepages = 0;
+static const char *huge_mode;		/* how the current heap got them */
+
+/* write tracking state, see mem_track_writes() */
+static int track_writes = 0;
+static char *prot_hi;				/* end of the write-protected range */
+static size_t npages;				/* number of pages in max_heap */
+static unsigned char *dirty;		/* one flag per heap page */
+static size_t *dirty_list;			/* indices of the pages flagged in dirty */
+static size_t ndirty;
+
+/*
+ * mem_set_max_heap - make the heaps set up by later calls to mem_init
+ *		size bytes large instead of MAX_HEAP
+ */
+void mem_set_max_heap(size_t size){
+	max_heap = size;
+}
+
+/*
+ * mem_set_hugepages - back the heaps set up by later calls to mem_init
+ *		with 2 MiB pages if on: from the hugetlb pool if it has room,
+ *		or else as transparent huge pages. Either way the heap starts on
+ *		a 2 MiB boundary. (Write tracking splits transparent huge pages,
+ *		and doesn't work on hugetlb ones.)
+ */
+void mem_set_hugepages(int on){
+	hugepages = on;
+}
+
+/*
+ * mem_hugepages - how the current heap is backed: "hugetlb", "thp",
+ *		"none" if huge pages were asked for but are not to be had, or
+ *		NULL if they weren't asked for
+ */
+const char *mem_hugepages(void){
+	return huge_mode;
+}
+
+/*
+ * map_huge - map the heap for mem_set_hugepages(1); NULL if we can't
+ */
+static char *map_huge(void){
+	char *p, *aligned;
+
+	map_size = (max_heap + HUGEPAGE_SIZE - 1) & ~(HUGEPAGE_SIZE - 1);
+#ifdef MAP_HUGETLB
+	p = mmap((void *)0x800000000, map_size, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+	if (p != MAP_FAILED) {
+		huge_mode = "hugetlb";
+		return p;
+	}
+#endif
+
+	/* Map a huge page too many and trim the ends to a 2 MiB boundary */
+	p = mmap((void *)0x800000000, map_size + HUGEPAGE_SIZE,
+			PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (p == MAP_FAILED)
+		return NULL;
+	aligned = (char *)(((uintptr_t)p + HUGEPAGE_SIZE - 1) &
+			~(HUGEPAGE_SIZE - 1));
+	if (aligned > p)
+		munmap(p, aligned - p);
+	if (p + HUGEPAGE_SIZE > aligned)
+		munmap(aligned + map_size, p + HUGEPAGE_SIZE - aligned);
+	huge_mode = "none";
+#ifdef MADV_HUGEPAGE
+	if (madvise(aligned, map_size, MADV_HUGEPAGE) == 0)
+		huge_mode = "thp";
+#endif
+	return aligned;
+}
 
 /* 
  * mem_init - initialize the memory system model
  */
 void mem_init(void){
-	int dev_zero = open("/dev/zero", O_RDWR);
+	int dev_zero;
+
+	huge_mode = NULL;
+	if (hugepages && (heap = map_huge()) != NULL) {
+		mem_max_addr = heap + max_heap;
+		mem_brk = heap;
+		return;
+	}
+	if (hugepages)
+		huge_mode = "none";
+	dev_zero = open("/dev/zero", O_RDWR);
+	map_size = max_heap;
 	heap = mmap((void *)0x800000000, /* suggested start*/
-			MAX_HEAP,				/* length */
+			max_heap,				/* length */
 			PROT_WRITE,				/* permissions */
 			MAP_PRIVATE,			/* private or shared? */
 			dev_zero,				/* fd */
 			0);						/* offset (dunno) */
-	mem_max_addr = heap + MAX_HEAP;
+	close(dev_zero);
+	mem_max_addr = heap + max_heap;
 	mem_brk = heap;					/* heap is empty initially */
 }
 
@@ -40,7 +132,8 @@ void mem_init(void){
  * mem_deinit - free the storage used by the memory system model
  */
 void mem_deinit(void){
-	munmap(heap, MAX_HEAP);
+	mem_track_writes(0);
+	munmap(heap, map_size);
 }
 
 /*
@@ -97,3 +190,158 @@ size_t mem_heapsize() {
 size_t mem_pagesize(){
 	return (size_t)getpagesize();
 }
+
+/*
+ * mem_resident() - returns how many bytes of the heap are resident in
+ *		physical memory, or 0 if the system can't tell us
+ */
+size_t mem_resident(){
+	unsigned char vec[1024];
+	size_t pagesize = mem_pagesize();
+	size_t npages = (mem_heapsize() + pagesize - 1) / pagesize;
+	size_t pg, i, n, count = 0;
+
+	for (pg = 0; pg < npages; pg += n) {
+		n = npages - pg < sizeof(vec) ? npages - pg : sizeof(vec);
+		if (mincore(heap + pg * pagesize, n * pagesize, vec) < 0)
+			return 0;
+		for (i = 0; i < n; i++)
+			count += vec[i] & 1;
+	}
+	return count * pagesize;
+}
+
+/*
+ * mem_huge_resident() - returns how many bytes of the heap the kernel
+ *		backs with transparent huge pages, from /proc/self/smaps
+ */
+size_t mem_huge_resident(){
+	FILE *fp;
+	char line[256];
+	unsigned long lo, hi;
+	size_t kb, total = 0;
+	int in_heap = 0;
+
+	if ((fp = fopen("/proc/self/smaps", "r")) == NULL)
+		return 0;
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		if (sscanf(line, "%lx-%lx ", &lo, &hi) == 2)
+			in_heap = (char *)lo < mem_brk && (char *)hi > heap;
+		else if (in_heap && sscanf(line, "AnonHugePages: %zu kB", &kb) == 1)
+			total += kb * 1024;
+	}
+	fclose(fp);
+	return total;
+}
+
+/*
+ * The following routines track which heap pages have been written.
+ * Tracked pages are kept read-only; the first write to one of them
+ * faults, and the handler flags the page dirty and makes it writable
+ * again. mem_dirty_reset() re-protects only the pages flagged since
+ * the last reset, so the cost per operation is proportional to the
+ * number of pages the operation touched.
+ */
+
+/*
+ * dirty_handler - SIGSEGV handler that records writes to tracked pages
+ */
+static void dirty_handler(int sig, siginfo_t *si, void *ctx){
+	char *addr = (char *)si->si_addr;
+	size_t pg;
+
+	(void)ctx;
+	if (track_writes && addr >= heap && addr < prot_hi) {
+		pg = (size_t)(addr - heap) / mem_pagesize();
+		if (!dirty[pg]) {
+			dirty[pg] = 1;
+			dirty_list[ndirty++] = pg;
+			mprotect(heap + pg * mem_pagesize(), mem_pagesize(),
+					PROT_READ | PROT_WRITE);
+			return;
+		}
+	}
+
+	/* Not ours: let the fault happen again with the default action */
+	signal(sig, SIG_DFL);
+}
+
+/*
+ * mem_track_writes - turn heap write tracking on or off
+ */
+void mem_track_writes(int on){
+	static int installed = 0;
+	struct sigaction sa;
+
+	if (on && !installed) {
+		npages = (max_heap + mem_pagesize() - 1) / mem_pagesize();
+		dirty = calloc(npages, sizeof(*dirty));
+		dirty_list = malloc(npages * sizeof(*dirty_list));
+		if (dirty == NULL || dirty_list == NULL) {
+			fprintf(stderr, "ERROR: mem_track_writes out of memory\n");
+			exit(1);
+		}
+		memset(&sa, 0, sizeof(sa));
+		sa.sa_sigaction = dirty_handler;
+		sa.sa_flags = SA_SIGINFO;
+		sigemptyset(&sa.sa_mask);
+		sigaction(SIGSEGV, &sa, NULL);
+		installed = 1;
+	}
+
+	if (on) {
+		track_writes = 1;
+		prot_hi = heap;
+		mem_dirty_reset();
+	} else if (track_writes) {
+		mprotect(heap, prot_hi - heap, PROT_READ | PROT_WRITE);
+		while (ndirty > 0)
+			dirty[dirty_list[--ndirty]] = 0;
+		track_writes = 0;
+		prot_hi = heap;
+	}
+}
+
+/*
+ * mem_dirty_reset - forget the dirty pages and write-protect every page
+ *		up to the current brk again
+ */
+void mem_dirty_reset(void){
+	size_t pagesize = mem_pagesize();
+	char *hi;
+
+	if (!track_writes)
+		return;
+
+	while (ndirty > 0) {
+		size_t pg = dirty_list[--ndirty];
+		dirty[pg] = 0;
+		mprotect(heap + pg * pagesize, pagesize, PROT_READ);
+	}
+
+	/* Pages the heap has grown into since the last reset */
+	hi = heap + (mem_heapsize() + pagesize - 1) / pagesize * pagesize;
+	if (hi > prot_hi) {
+		mprotect(prot_hi, hi - prot_hi, PROT_READ);
+		prot_hi = hi;
+	}
+}
+
+/*
+ * mem_range_dirty - return true if any byte of [lo, hi] may have been
+ *		written since the last mem_dirty_reset()
+ */
+int mem_range_dirty(const void *lo, const void *hi){
+	size_t pg, last;
+
+	if (!track_writes)
+		return 1;
+	if ((char *)lo < heap || (char *)hi >= prot_hi)
+		return 1;
+	pg = ((char *)lo - heap) / mem_pagesize();
+	last = ((char *)hi - heap) / mem_pagesize();
+	for (; pg <= last; pg++)
+		if (dirty[pg])
+			return 1;
+	return 0;
+}
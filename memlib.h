@@ -1,5 +1,8 @@
 #include <unistd.h>
 
+void mem_set_max_heap(size_t size);
+void mem_set_hugepages(int on);
+const char *mem_hugepages(void);
 void mem_init(void);               
 void mem_deinit(void);
 void *mem_sbrk(int incr);
@@ -8,4 +11,10 @@ void *mem_heap_lo(void);
 void *mem_heap_hi(void);
 size_t mem_heapsize(void);
 size_t mem_pagesize(void);
+size_t mem_resident(void);
+size_t mem_huge_resident(void);
+
+void mem_track_writes(int on);
+void mem_dirty_reset(void);
+int mem_range_dirty(const void *lo, const void *hi);
 
@@ -44,12 +44,15 @@
 #define SIZE_T_SIZE (ALIGN(sizeof(size_t)))
 #define SIZE_PTR(p)  ((size_t*)(((char*)(p)) - SIZE_T_SIZE))
 
+static unsigned long sbrk_calls; /* one per malloc, for mm_stats */
+
 /*
  * mm_init - Called when a new trace starts. 
  * CAUTION: You must reset all of your global pointers here. 
  */
 int mm_init(void)
 {
+    sbrk_calls = 0;
     return 0;
 }
 
@@ -66,6 +69,7 @@ void *malloc(size_t size)
     if ((long)p < 0)
         return NULL;
     else {
+        sbrk_calls++;
         p += SIZE_T_SIZE;
         *SIZE_PTR(p) = size;
         return p;
@@ -121,6 +125,58 @@ void *realloc(void *oldptr, size_t size)
     return newptr;
 }
 
+/*
+ * mm_usable_size - The block is exactly as large as its aligned size.
+ */
+size_t mm_usable_size(void *ptr)
+{
+    if (ptr == NULL)
+        return 0;
+    return ALIGN(*SIZE_PTR(ptr) + SIZE_T_SIZE) - SIZE_T_SIZE;
+}
+
+/*
+ * mm_free_bytes - Nothing is ever freed, so there are no free blocks.
+ */
+size_t mm_free_bytes(void)
+{
+    return 0;
+}
+
+/*
+ * mm_setparam - There is nothing to tune.
+ */
+int mm_setparam(const char *name, const char *value)
+{
+    return -1;
+}
+
+/*
+ * mm_stats - Nothing is ever free, and the whole heap is allocated
+ */
+void mm_stats(mm_stats_t *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    stats->heapsize = mem_heapsize();
+    stats->alloc_bytes = stats->heapsize;
+    stats->sbrk_calls = sbrk_calls;
+}
+
+/*
+ * mm_heap_walk - Every block is allocated, and starts with the size
+ *                that was asked for
+ */
+void mm_heap_walk(mm_walk_fn fn, void *arg)
+{
+    char *lo = mem_heap_lo();
+    size_t offset, size;
+
+    for (offset = 0; offset < mem_heapsize(); offset += size) {
+        size = ALIGN(*(size_t *)(lo + offset) + SIZE_T_SIZE);
+        fn(offset, size, 1, arg);
+    }
+}
+
 /*
  * calloc - Allocate the block and set it to zero.
  */
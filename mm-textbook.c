@@ -53,6 +53,8 @@
 
 /* Global variables */
 static char *heap_listp = 0;  /* Pointer to first block */  
+static size_t free_bytes = 0; /* Total size of the free blocks */
+static unsigned long sbrk_calls, splits, coalesces; /* for mm_stats */
 #ifdef NEXT_FIT
 static char *rover;           /* Next fit rover */
 #endif
@@ -76,6 +78,9 @@ int mm_init(void)
     PUT(heap_listp + (2*WSIZE), PACK(DSIZE, 1)); /* Prologue footer */ 
     PUT(heap_listp + (3*WSIZE), PACK(0, 1));     /* Epilogue header */
     heap_listp += (2*WSIZE);                     
+    free_bytes = 0;
+    sbrk_calls = 1;
+    splits = coalesces = 0;
 
 #ifdef NEXT_FIT
     rover = heap_listp;
@@ -138,6 +143,7 @@ void free(void *bp)
 
     PUT(HDRP(bp), PACK(size, 0));
     PUT(FTRP(bp), PACK(size, 0));
+    free_bytes += size;
     coalesce(bp);
 }
 
@@ -178,6 +184,91 @@ void *realloc(void *ptr, size_t size)
     return newptr;
 }
 
+/*
+ * calloc - Allocate the block and set it to zero
+ */
+void *calloc(size_t nmemb, size_t size)
+{
+    size_t bytes = nmemb * size;
+    void *newptr;
+
+    if ((newptr = malloc(bytes)) != NULL)
+        memset(newptr, 0, bytes);
+    return newptr;
+}
+
+/*
+ * mm_usable_size - Payload bytes in the block, i.e. all but the header
+ *                  and footer
+ */
+size_t mm_usable_size(void *ptr)
+{
+    if (ptr == NULL)
+        return 0;
+    return GET_SIZE(HDRP(ptr)) - DSIZE;
+}
+
+/*
+ * mm_free_bytes - Total size of the free blocks in the heap
+ */
+size_t mm_free_bytes(void)
+{
+    return free_bytes;
+}
+
+/*
+ * mm_stats - Fill in a snapshot of the counters. There is one
+ *            implicit list, so we walk the heap for the free blocks.
+ */
+void mm_stats(mm_stats_t *stats)
+{
+    char *bp;
+    size_t size;
+
+    memset(stats, 0, sizeof(*stats));
+    if (heap_listp == 0)
+        return;
+    stats->nclasses = 1;
+    for (bp = heap_listp; (size = GET_SIZE(HDRP(bp))) > 0; bp = NEXT_BLKP(bp)) {
+        if (GET_ALLOC(HDRP(bp))) {
+            if (bp != heap_listp)  /* not the prologue */
+                stats->alloc_bytes += size;
+            continue;
+        }
+        stats->class_blocks[0]++;
+        stats->class_bytes[0] += size;
+        stats->largest_free = MAX(stats->largest_free, size);
+    }
+    stats->free_bytes = free_bytes;
+    stats->heapsize = mem_heapsize();
+    stats->sbrk_calls = sbrk_calls;
+    stats->splits = splits;
+    stats->coalesces = coalesces;
+}
+
+/*
+ * mm_heap_walk - Call fn for every block between the prologue and the
+ *                epilogue
+ */
+void mm_heap_walk(mm_walk_fn fn, void *arg)
+{
+    char *bp;
+    char *lo = mem_heap_lo();
+
+    if (heap_listp == 0)
+        return;
+    for (bp = NEXT_BLKP(heap_listp); GET_SIZE(HDRP(bp)) > 0; bp = NEXT_BLKP(bp))
+        fn(HDRP(bp) - lo, GET_SIZE(HDRP(bp)), GET_ALLOC(HDRP(bp)), arg);
+}
+
+/*
+ * mm_setparam - The textbook allocator has no tunable parameters
+ */
+int mm_setparam(const char *name, const char *value)
+{
+    return -1;
+}
+
 /* 
  * mm_checkheap - Check the heap for correctness. Helpful hint: You
  *                can call this function using mm_checkheap(__LINE__);
@@ -204,11 +295,13 @@ static void *extend_heap(size_t words)
     size = (words % 2) ? (words+1) * WSIZE : words * WSIZE; 
     if ((long)(bp = mem_sbrk(size)) == -1)  
         return NULL;                                        
+    sbrk_calls++;
 
     /* Initialize free block header/footer and the epilogue header */
     PUT(HDRP(bp), PACK(size, 0));         /* Free block header */   
     PUT(FTRP(bp), PACK(size, 0));         /* Free block footer */   
     PUT(HDRP(NEXT_BLKP(bp)), PACK(0, 1)); /* New epilogue header */ 
+    free_bytes += size;
 
     /* Coalesce if the previous block was free */
     return coalesce(bp);                                          
@@ -231,6 +324,7 @@ static void *coalesce(void *bp)
         size += GET_SIZE(HDRP(NEXT_BLKP(bp)));
         PUT(HDRP(bp), PACK(size, 0));
         PUT(FTRP(bp), PACK(size,0));
+        coalesces++;
     }
 
     else if (!prev_alloc && next_alloc) {      /* Case 3 */
@@ -238,6 +332,7 @@ static void *coalesce(void *bp)
         PUT(FTRP(bp), PACK(size, 0));
         PUT(HDRP(PREV_BLKP(bp)), PACK(size, 0));
         bp = PREV_BLKP(bp);
+        coalesces++;
     }
 
     else {                                     /* Case 4 */
@@ -246,6 +341,7 @@ static void *coalesce(void *bp)
         PUT(HDRP(PREV_BLKP(bp)), PACK(size, 0));
         PUT(FTRP(NEXT_BLKP(bp)), PACK(size, 0));
         bp = PREV_BLKP(bp);
+        coalesces += 2;
     }
 #ifdef NEXT_FIT
     /* Make sure the rover isn't pointing into the free block */
@@ -264,12 +360,15 @@ static void place(void *bp, size_t asize)
 {
     size_t csize = GET_SIZE(HDRP(bp));   
 
+    free_bytes -= csize;
     if ((csize - asize) >= (2*DSIZE)) { 
+        free_bytes += csize - asize;
         PUT(HDRP(bp), PACK(asize, 1));
         PUT(FTRP(bp), PACK(asize, 1));
         bp = NEXT_BLKP(bp);
         PUT(HDRP(bp), PACK(csize-asize, 0));
         PUT(FTRP(bp), PACK(csize-asize, 0));
+        splits++;
     }
     else { 
         PUT(HDRP(bp), PACK(csize, 1));
@@ -2,9 +2,12 @@
  * Simple, 32-bit and 64-bit clean allocator based on implicit free
  * lists, first-fit placement, and boundary tag coalescing, as described
  * in the CS:APP3e text. Blocks must be aligned to doubleword (8 byte)
- * boundaries. Minimum block size is 16 bytes.
+ * boundaries, or 16 byte ones when built as the process's malloc.
+ * Minimum block size is 16 bytes.
  */
 #include <assert.h>
+#include <errno.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -12,12 +15,65 @@
 
 #include "mm.h"
 #include "memlib.h"
+#include "evlog.h"
+#ifndef DRIVER
+#include <malloc.h>
+#include "heapprof.h"
+#include "statpage.h"
+#endif
 
 //#define DEBUG
 #ifdef DEBUG
 # define dbg_printf(...) printf(__VA_ARGS__)
 #else
 # define dbg_printf(...)
+#endif
+
+/*
+ * Instrumentation, compiled in with -DMM_INSTRUMENT. INSTR() keeps its
+ * statement only then. PHASE_BEGIN/PHASE_END bracket the body of a
+ * phase (find_fit, place, ...); its cycles exclude those of any phase
+ * it calls, so they add up to the time spent in all of them.
+ */
+#ifdef MM_INSTRUMENT
+#include "clock.h"
+mm_instr_t mm_instr;
+static int instr_phase = -1;                /* phase we are in, if any */
+static unsigned long long instr_since;      /* when its cycles last counted */
+
+static int instr_enter(int phase) {
+    unsigned long long now = read_counter();
+    int outer = instr_phase;
+
+    if (outer >= 0)
+        mm_instr.cycles[outer] += now - instr_since;
+    instr_since = now;
+    instr_phase = phase;
+    mm_instr.calls[phase]++;
+    return outer;
+}
+static void instr_leave(int outer) {
+    unsigned long long now = read_counter();
+
+    mm_instr.cycles[instr_phase] += now - instr_since;
+    instr_since = now;
+    instr_phase = outer;
+}
+static void instr_search(unsigned long nodes) {
+    int b = 0;
+
+    while (nodes >> b != 0 && b < MM_SEARCH_BUCKETS - 1)
+        b++;
+    mm_instr.search_hist[b]++;
+    mm_instr.nodes += nodes;
+}
+# define INSTR(...) __VA_ARGS__
+# define PHASE_BEGIN(phase) int outer_phase = instr_enter(phase)
+# define PHASE_END() instr_leave(outer_phase)
+#else
+# define INSTR(...)
+# define PHASE_BEGIN(phase)
+# define PHASE_END()
 #endif
  /* do not change the following! */
 #ifdef DRIVER
@@ -28,11 +84,18 @@
 #define calloc mm_calloc
 #endif /* def DRIVER */
 
-/* single word (4) or double word (8) alignment */
+/* double word (8) alignment for the driver; as the process's malloc,
+   16, which is what the x86-64 ABI promises (alignof(max_align_t)).
+   Block sizes are kept multiples of it, and the first payload is 16
+   bytes into the heap. */
+#ifdef DRIVER
 #define ALIGNMENT 8
+#else
+#define ALIGNMENT 16
+#endif
 
 /* rounds up to the nearest multiple of ALIGNMENT */
-#define ALIGN(p) (((size_t)(p) + (ALIGNMENT-1)) & ~0x7)
+#define ALIGN(p) (((size_t)(p) + (ALIGNMENT-1)) & ~(size_t)(ALIGNMENT-1))
 
 /*
  * If NEXT_FIT defined use next fit search, else use first-fit search
@@ -57,6 +120,10 @@
 #define GET_SIZE(p)  (GET(p) & ~0x7)                   
 #define GET_ALLOC(p) (GET(p) & 0x1)                    
 
+/* An allocated block the heap profiler sampled has this bit set in its
+   header and footer (interposed build only) */
+#define SAMPLED 0x4
+
 /* Given block ptr bp, compute address of its header and footer */
 #define HDRP(bp)       ((char *)(bp) - WSIZE)                      
 #define FTRP(bp)       ((char *)(bp) + GET_SIZE(HDRP(bp)) - DSIZE) 
@@ -71,37 +138,58 @@
 
 /* Global variables */
 static char* heap_listp = 0;  /* Pointer to first block */
-static int free_head1 = 0;      //4  -  8
-static int free_head2 = 0;      //8 	12
-static int free_head3 = 0;		//12	16
-static int free_head4 = 0;		//16	32
-static int free_head5 = 0;		//32	64
-static int free_head6 = 0;		//64	128
-static int free_head7 = 0;		//128	256
-static int free_head8 = 0;		//256
-static int free_head9 = 0;
-static int free_head10 = 0;
-static int free_head11 = 0;
-static int free_head12 = 0;
-static int free_head13 = 0;
-static int free_head14 = 0;
+
+/*
+ * Tunable parameters, set with mm_setparam() or, the first time
+ * mm_init runs, from MM_* environment variables. Free blocks are kept
+ * in nclasses lists: list i holds the blocks of at most class_limit[i]
+ * bytes that don't fit an earlier list, and the last list holds the
+ * rest.
+ */
+#define MAXCLASSES MM_MAXCLASSES
+static struct {
+    int nclasses;                     /* number of free lists */
+    size_t class_limit[MAXCLASSES];   /* largest block in each list */
+    size_t chunksize;                 /* extend heap by at least this */
+    size_t split_min;                 /* smallest remainder place() splits off */
+    size_t growth;                    /* and by this percent of the heap */
+    size_t align;                     /* to end it on a multiple of this */
+    int best_fit;                     /* search a whole list for the best fit */
+} cfg = {
+    14,
+    { 28, 64, 96, 128, 192, 256, 384, 512, 768, 1024, 1536, 2048, 4096 },
+    CHUNKSIZE,
+    2 * DSIZE,
+    0,
+    0,
+    0
+};
+static int free_heads[MAXCLASSES];  /* offset of each list's first block */
+
+/*
+ * Counters behind mm_stats(). They cost an add or two per change to
+ * the heap, so they are always kept.
+ */
+static struct {
+    size_t class_blocks[MAXCLASSES];  /* free blocks in each list */
+    size_t class_bytes[MAXCLASSES];   /* and their total size */
+    unsigned long sbrk_calls;
+    unsigned long splits;
+    unsigned long coalesces;
+} counters;
+
+/* Index of the free list for blocks of size bytes */
+static int getclass(size_t size) {
+    int i;
+    for (i = 0; i < cfg.nclasses - 1; i++)
+        if (size <= cfg.class_limit[i])
+            return i;
+    return cfg.nclasses - 1;
+}
 static int* getfree_head(size_t size) {
     if (size < 2 * DSIZE)
         return NULL;
-    if (size <= 28) return &free_head1;
-    if (size <= 64) return &free_head2;
-	if (size <= 96) return &free_head3;
-    if (size <= 128) return &free_head4;
-	if (size <= 192) return &free_head5;
-    if (size <= 256) return &free_head6;
-	if (size <= 384) return &free_head7;
-    if (size <= 512) return &free_head8;
-	if (size <= 768) return &free_head9;
-    if (size <= 1024) return &free_head10;
-	if (size <= 1536) return &free_head11;
-    if (size <= 2048) return &free_head12;
-	if (size <= 4096) return &free_head13;
-    return &free_head14;
+    return &free_heads[getclass(size)];
 }
 static void add_block(void* bp);
 
@@ -114,38 +202,67 @@ static int in_heap(const void* p);
 static int aligned(const void* p);
 void mm_checkheap(int lineno);
 static int heap_top = 0;
+static size_t free_bytes = 0;   /* total size of the blocks in the free lists */
+
+/* How the last request was served, for the event log: the free list
+   its block came from (or EV_HEAP), and the blocks find_fit looked at;
+   and the list the last block freed went to */
+static int served_class;
+static unsigned fit_search;
+static int freed_class;
+
+static void* alloc_block(size_t size);
+static void* free_block(void* bp);
+static void* realloc_block(void* ptr, size_t size);
+static void getenv_params(void);
+static size_t heap_growth(size_t asize, int grow);
+
+#ifndef DRIVER
+/*
+ * prof_mark - The profiler's countdown ran out in the request for bp:
+ *     flag the block if the profiler kept it, so free tells it
+ */
+static void prof_mark(void* bp, size_t size)
+{
+    if (prof_sample(bp, size)) {
+        PUT(HDRP(bp), GET(HDRP(bp)) | SAMPLED);
+        PUT(FTRP(bp), GET(FTRP(bp)) | SAMPLED);
+    }
+}
+#endif
 /*
  * mm_init - Initialize the memory manager
  */
 int mm_init(void)
 {
+    size_t chunk;
+
+    getenv_params();
+    chunk = cfg.chunksize;
+
     /* Create the initial empty heap */
-    if ((heap_listp = mem_sbrk(CHUNKSIZE)) == (void*)-1)
+    if ((heap_listp = mem_sbrk(chunk)) == (void*)-1)
         return -1;
-    free_head10 = 3 * WSIZE;
-	free_head1 = 0;
-	free_head2 = 0;
-	free_head3 = 0;
-	free_head4 = 0;
-	free_head5 = 0;
-	free_head6 = 0;
-	free_head7 = 0;
-	free_head8 = 0;
-	free_head9 = 0;
-	free_head12 = 0;
-	free_head13 = 0;
-	free_head11 = 0;
-	free_head14 = 0;
+    memset(free_heads, 0, sizeof(free_heads));
+    memset(&counters, 0, sizeof(counters));
+    counters.sbrk_calls = 1;
+    counters.class_blocks[getclass(chunk - 4 * WSIZE)] = 1;
+    counters.class_bytes[getclass(chunk - 4 * WSIZE)] = chunk - 4 * WSIZE;
+    free_heads[getclass(chunk - 4 * WSIZE)] = 3 * WSIZE;
     PUT(heap_listp, PACK(3 * WSIZE, 1));
     PUT(heap_listp + (1 * WSIZE), 0);
     PUT(heap_listp + (2 * WSIZE), PACK(3 * WSIZE, 1));
-    PUT(heap_listp + (3 * WSIZE), PACK(CHUNKSIZE - 4 * WSIZE, 0)); /* Prologue header */
+    PUT(heap_listp + (3 * WSIZE), PACK(chunk - 4 * WSIZE, 0)); /* Prologue header */
     PUT(heap_listp + (4 * WSIZE), 0);  /*Prologue son*/
     PUT(heap_listp + (5 * WSIZE), 0);   /*Prologue father, no use*/
-    PUT(heap_listp + (CHUNKSIZE - 2 * WSIZE), PACK(CHUNKSIZE - 4 * WSIZE, 0)); /* Prologue footer */
-    PUT(heap_listp + (CHUNKSIZE - 1 * WSIZE), PACK(0, 1));
+    PUT(heap_listp + (chunk - 2 * WSIZE), PACK(chunk - 4 * WSIZE, 0)); /* Prologue footer */
+    PUT(heap_listp + (chunk - 1 * WSIZE), PACK(0, 1));
     heap_listp += WSIZE;
-    heap_top = CHUNKSIZE - 1 * WSIZE;
+    heap_top = chunk - 1 * WSIZE;
+    free_bytes = chunk - 4 * WSIZE;
+    INSTR(memset(&mm_instr, 0, sizeof(mm_instr)); instr_phase = -1);
+    if (evlog_on)
+        evlog_put(EV_INIT, chunk, NULL, NULL, EV_NOCLASS, 0);
     /* Extend the empty heap with a free block of CHUNKSIZE bytes */
     //if (extend_heap(CHUNKSIZE/WSIZE) == NULL) 
         //return -1;
@@ -156,43 +273,374 @@ int mm_init(void)
  * malloc - Allocate a block with at least size bytes of payload
  */
 void* malloc(size_t size)
+{
+    void* bp = alloc_block(size);
+
+    if (evlog_on)
+        EVLOG_PUT(EV_MALLOC, size, bp, NULL, served_class, fit_search);
+#ifndef DRIVER
+    if ((prof_countdown -= size) < 0)
+        prof_mark(bp, size);
+    STATPAGE_COUNT(SP_MALLOC);
+#endif
+    return bp;
+}
+
+/*
+ * alloc_block - malloc, less the logging
+ */
+static void* alloc_block(size_t size)
 {
     size_t asize;      /* Adjusted block size */
     size_t extendsize; /* Amount to extend heap if no fit */
     char* bp;
     if (heap_listp == 0) {
+#ifndef DRIVER
+        /* As the process's malloc, nobody else sets up the heap */
+        mem_init();
+#endif
         if (mm_init() == -1) {
             printf("init false\n");
             exit(0);
         }
+#ifndef DRIVER
+        prof_init();
+        statpage_init();
+        evlog_init();
+#endif
     }
-    /* Ignore spurious requests */
-    if (size == 0){
+    served_class = EV_NOCLASS;
+    fit_search = 0;
+    /* Ignore spurious requests, and those the int offsets can't span */
+    if (size == 0 || size > INT_MAX / 2){
         return NULL;}
     /* Adjust block size to include overhead and alignment reqs. */
-    if (size <= DSIZE)
-        asize = 2 * DSIZE;
-    else{
-        asize = DSIZE * ((size + (DSIZE)+(DSIZE - 1)) / DSIZE);}
+    asize = MAX(ALIGN(size + DSIZE), 2 * DSIZE);
     /* Search the free list for a fit */
     if ((bp = (char*)find_fit(asize)) != NULL) {
+        INSTR(mm_instr.class_served[served_class]++);
         place(bp, asize);
         return bp;
     }
-    /* No fit found. Get more memory and place the block */
-    extendsize = MAX(asize, CHUNKSIZE);
-    if ((bp = (char*)extend_heap(extendsize / WSIZE)) == NULL)
+    /* No fit found. Get more memory and place the block, settling for
+       less than the growth parameter asks for if there's no room */
+    extendsize = heap_growth(asize, 1);
+    if ((bp = (char*)extend_heap(extendsize / WSIZE)) == NULL &&
+        heap_growth(asize, 0) < extendsize)
+        bp = (char*)extend_heap(heap_growth(asize, 0) / WSIZE);
+    if (bp == NULL)
         return NULL;
+    served_class = EV_HEAP;
+    INSTR(mm_instr.heap_served++);
     place(bp, asize);
     return bp;
 }
 
 void* calloc(size_t nmemb, size_t size) {
-    void* ptr = malloc(nmemb * size);
-    memset(ptr, 0, nmemb * size - WSIZE);
+    void* ptr;
+
+    if (size != 0 && nmemb > (size_t)-1 / size)
+        return NULL;
+    if ((ptr = malloc(nmemb * size)) != NULL)
+        memset(ptr, 0, nmemb * size);
     return ptr;
 }
 
+#ifndef DRIVER
+/*
+ * The rest of the C library's allocation interface, so that a program
+ * that asks for aligned blocks, or how big its blocks are, gets its
+ * answer from us rather than from the allocator we displaced
+ */
+
+/*
+ * align_block - alloc_block for a payload aligned to align bytes, a
+ *     power of two. A block with room for the payload at any alignment
+ *     is allocated, and what lies before and after the aligned payload's
+ *     block is freed again. Both are multiples of ALIGNMENT, so neither
+ *     is too small to be a block.
+ */
+static void* align_block(size_t align, size_t size)
+{
+    size_t asize, bsize, lead;
+    char* bp;
+    char* ap;
+
+    if (align <= ALIGNMENT)
+        return alloc_block(size);
+    if (size == 0 || size > INT_MAX / 2 || align > INT_MAX / 2 ||
+        (bp = alloc_block(size + align + 2 * DSIZE)) == NULL)
+        return NULL;
+    asize = MAX(ALIGN(size + DSIZE), 2 * DSIZE);
+    bsize = GET_SIZE(HDRP(bp));
+    lead = (align - (size_t)bp % align) % align;
+    ap = bp + lead;
+    if (lead > 0) {
+        PUT(HDRP(ap), PACK(bsize - lead, 1));
+        PUT(FTRP(ap), PACK(bsize - lead, 1));
+        PUT(HDRP(bp), PACK(lead, 1));
+        PUT(FTRP(bp), PACK(lead, 1));
+        free_block(bp);
+        bsize -= lead;
+    }
+    if (bsize - asize >= cfg.split_min) {
+        PUT(HDRP(ap), PACK(asize, 1));
+        PUT(FTRP(ap), PACK(asize, 1));
+        bp = NEXT_BLKP(ap);
+        PUT(HDRP(bp), PACK(bsize - asize, 1));
+        PUT(FTRP(bp), PACK(bsize - asize, 1));
+        free_block(bp);
+    }
+    return ap;
+}
+
+/*
+ * aligned_malloc - malloc for a payload aligned to align bytes
+ */
+static void* aligned_malloc(size_t align, size_t size)
+{
+    void* bp = align_block(align, size);
+
+    if (evlog_on)
+        EVLOG_PUT(EV_MALLOC, size, bp, NULL, served_class, fit_search);
+    if ((prof_countdown -= size) < 0)
+        prof_mark(bp, size);
+    STATPAGE_COUNT(SP_MALLOC);
+    return bp;
+}
+
+int posix_memalign(void** memptr, size_t align, size_t size)
+{
+    void* bp;
+
+    if (align == 0 || (align & (align - 1)) != 0 || align % sizeof(void*) != 0)
+        return EINVAL;
+    if ((bp = aligned_malloc(align, size)) == NULL && size != 0)
+        return ENOMEM;
+    *memptr = bp;
+    return 0;
+}
+
+void* memalign(size_t align, size_t size)
+{
+    if (align == 0 || (align & (align - 1)) != 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+    return aligned_malloc(align, size);
+}
+
+void* aligned_alloc(size_t align, size_t size)
+{
+    return memalign(align, size);
+}
+
+void* valloc(size_t size)
+{
+    return memalign(mem_pagesize(), size);
+}
+
+void* pvalloc(size_t size)
+{
+    size_t page = mem_pagesize();
+
+    return memalign(page, (size + page - 1) & ~(page - 1));
+}
+
+size_t malloc_usable_size(void* ptr)
+{
+    return mm_usable_size(ptr);
+}
+#endif
+
+
+/*
+ * mm_usable_size - Number of payload bytes in the block at ptr, which
+ *                  is the block size less its header and footer
+ */
+size_t mm_usable_size(void* ptr) {
+    if (ptr == NULL)
+        return 0;
+    return GET_SIZE(HDRP(ptr)) - DSIZE;
+}
+
+/*
+ * mm_free_bytes - Number of bytes in free blocks, headers included
+ */
+size_t mm_free_bytes(void) {
+    return free_bytes;
+}
+
+/*
+ * mm_stats - Fill in a snapshot of the counters. The largest free
+ *            block is looked up here rather than kept: it can only be
+ *            in the last list that isn't empty.
+ */
+void mm_stats(mm_stats_t* stats) {
+    int i;
+    char* bp;
+
+    memset(stats, 0, sizeof(*stats));
+    if (heap_listp == 0)
+        return;
+    stats->nclasses = cfg.nclasses;
+    memcpy(stats->class_blocks, counters.class_blocks,
+           cfg.nclasses * sizeof(size_t));
+    memcpy(stats->class_bytes, counters.class_bytes,
+           cfg.nclasses * sizeof(size_t));
+    for (i = cfg.nclasses - 1; i >= 0 && free_heads[i] == 0; i--)
+        ;
+    if (i >= 0) {
+        for (bp = heap_listp + free_heads[i]; ; bp = SNRP(bp)) {
+            stats->largest_free = MAX(stats->largest_free, GET_SIZE(HDRP(bp)));
+            if ((*(int*)(bp) == 0))
+                break;
+        }
+    }
+    stats->free_bytes = free_bytes;
+    stats->heapsize = heap_top + WSIZE;
+    /* all but the free blocks, the prologue and the epilogue */
+    stats->alloc_bytes = stats->heapsize - free_bytes - 4 * WSIZE;
+    stats->sbrk_calls = counters.sbrk_calls;
+    stats->splits = counters.splits;
+    stats->coalesces = counters.coalesces;
+}
+
+/*
+ * mm_heap_walk - Call fn for every block between the prologue and the
+ *                epilogue. The prologue's header says 12 bytes, which
+ *                GET_SIZE can't represent, so we start from the first
+ *                block, 3 words past heap_listp, as mm_init does.
+ */
+void mm_heap_walk(mm_walk_fn fn, void* arg) {
+    char* bp;
+    char* lo = mem_heap_lo();
+
+    if (heap_listp == 0)
+        return;
+    for (bp = heap_listp + 3 * WSIZE; GET_SIZE(HDRP(bp)) > 0; bp = NEXT_BLKP(bp))
+        fn(HDRP(bp) - lo, GET_SIZE(HDRP(bp)), GET_ALLOC(HDRP(bp)), arg);
+}
+
+/*
+ * mm_setparam - Set a tunable parameter before the next mm_init:
+ *     "chunksize" - least number of bytes to extend the heap by
+ *     "growth"    - least percent of the heap to extend it by (0: none)
+ *     "align"     - end the heap on a multiple of this many bytes when
+ *                   extending it, e.g. 2097152 for huge pages (0: don't)
+ *     "split"     - smallest remainder place() splits off a block
+ *     "classes"   - comma-separated upper limits of the free lists
+ *                   (in increasing order; one more list takes the rest)
+ *     "fit"       - "first" or "best" fit within a list
+ *   Returns 0, or -1 if the name or value is bad. A parameter set here
+ *   is not overridden by its MM_* environment variable.
+ */
+static const char* const param_names[] = {
+    "chunksize", "growth", "align", "split", "classes", "fit"
+};
+#define NPARAMS (int)(sizeof(param_names) / sizeof(param_names[0]))
+static unsigned params_set;  /* bit i: param_names[i] set by mm_setparam */
+
+static int setparam(const char* name, const char* value);
+
+int mm_setparam(const char* name, const char* value) {
+    int i;
+
+    if (setparam(name, value) < 0)
+        return -1;
+    for (i = 0; i < NPARAMS; i++)
+        if (strcmp(name, param_names[i]) == 0)
+            params_set |= 1U << i;
+    return 0;
+}
+
+/*
+ * getenv_params - Set the parameters mm_setparam hasn't from MM_CHUNKSIZE,
+ *     MM_GROWTH, MM_ALIGN, MM_SPLIT, MM_CLASSES and MM_FIT. Only the
+ *     first mm_init looks; from then on the parameters live in cfg alone.
+ */
+static void getenv_params(void) {
+    static int done = 0;
+    char var[32];
+    const char* value;
+    int i, j;
+
+    if (done)
+        return;
+    done = 1;
+    for (i = 0; i < NPARAMS; i++) {
+        if (params_set & (1U << i))
+            continue;
+        strcpy(var, "MM_");
+        for (j = 0; param_names[i][j] != '\0'; j++)
+            var[3 + j] = param_names[i][j] - 'a' + 'A';
+        var[3 + j] = '\0';
+        if ((value = getenv(var)) != NULL && setparam(param_names[i], value) < 0)
+            fprintf(stderr, "mm: ignoring bad %s=%s\n", var, value);
+    }
+}
+
+static int setparam(const char* name, const char* value) {
+    char* end;
+    unsigned long v;
+    size_t limits[MAXCLASSES];
+    int n = 0;
+
+    if (strcmp(name, "classes") == 0) {
+        while (*value != '\0') {
+            v = strtoul(value, &end, 0);
+            if (end == value || n == MAXCLASSES - 1 ||
+                (n > 0 && v <= limits[n - 1]) || v < 2 * DSIZE)
+                return -1;
+            limits[n++] = v;
+            value = (*end == ',') ? end + 1 : end;
+            if (*end != ',' && *end != '\0')
+                return -1;
+        }
+        memcpy(cfg.class_limit, limits, n * sizeof(size_t));
+        cfg.nclasses = n + 1;
+        return 0;
+    }
+    if (strcmp(name, "fit") == 0) {
+        if (strcmp(value, "first") == 0)
+            cfg.best_fit = 0;
+        else if (strcmp(value, "best") == 0)
+            cfg.best_fit = 1;
+        else
+            return -1;
+        return 0;
+    }
+
+    v = strtoul(value, &end, 0);
+    if (end == value || *end != '\0')
+        return -1;
+    if (strcmp(name, "chunksize") == 0) {
+        /* room for the prologue, one free block and the epilogue */
+        if (v % ALIGNMENT != 0 || v < 4 * WSIZE + 2 * DSIZE || v > (1UL << 30))
+            return -1;
+        cfg.chunksize = v;
+        return 0;
+    }
+    if (strcmp(name, "split") == 0) {
+        if (v % ALIGNMENT != 0 || v < 2 * DSIZE)
+            return -1;
+        cfg.split_min = v;
+        return 0;
+    }
+    if (strcmp(name, "growth") == 0) {
+        if (v > 1000)
+            return -1;
+        cfg.growth = v;
+        return 0;
+    }
+    if (strcmp(name, "align") == 0) {
+        if ((v & (v - 1)) != 0 || (v != 0 && v < ALIGNMENT) || v > (1UL << 30))
+            return -1;
+        cfg.align = v;
+        return 0;
+    }
+    return -1;
+}
 
 /*
  * Return whether the pointer is in the heap.
@@ -215,114 +663,247 @@ void* calloc(size_t nmemb, size_t size) {
    * free - Free a block
    */
 void free(void* bp)
+{
+    void* blk;
+
+#ifndef DRIVER
+    if (bp != NULL && (GET(HDRP(bp)) & SAMPLED))
+        prof_forget(bp);
+#endif
+    blk = free_block(bp);
+
+    if (evlog_on)
+        EVLOG_PUT(EV_FREE, 0, bp, NULL, blk ? freed_class : EV_NOCLASS, 0);
+#ifndef DRIVER
+    STATPAGE_COUNT(SP_FREE);
+#endif
+}
+
+/*
+ * free_block - free, less the logging. Returns the free block bp ended
+ *              up in after coalescing, or NULL if it wasn't freed.
+ */
+static void* free_block(void* bp)
 {
     if (bp == 0)
-        return;
+        return NULL;
 
     size_t size = GET_SIZE(HDRP(bp));
     if (heap_listp == 0) {
         mm_init();
     }
 	if(!GET_ALLOC(HDRP(bp)))
-		return;
+		return NULL;
     PUT(HDRP(bp), PACK(size, 0));
     PUT(FTRP(bp), PACK(size, 0));
-    coalesce(bp);
+    return coalesce(bp);
 }
 
 /*
  * realloc - Naive implementation of realloc
  */
 void* realloc(void* ptr, size_t size)
+{
+    void* newptr;
+
+#ifndef DRIVER
+    if (ptr != NULL && (GET(HDRP(ptr)) & SAMPLED))
+        prof_forget(ptr);
+#endif
+    newptr = realloc_block(ptr, size);
+    if (evlog_on)
+        EVLOG_PUT(EV_REALLOC, size, newptr, ptr,
+                  size ? served_class : EV_NOCLASS, size ? fit_search : 0);
+#ifndef DRIVER
+    if ((prof_countdown -= size) < 0)
+        prof_mark(newptr, size);
+    STATPAGE_COUNT(SP_REALLOC);
+#endif
+    return newptr;
+}
+
+/*
+ * realloc_block - realloc, less the logging
+ */
+static void* realloc_block(void* ptr, size_t size)
 {
     size_t oldsize;
     void* newptr;
 
     /* If size == 0 then this is just free, and we return NULL. */
     if (size == 0) {
-        free(ptr);
+        free_block(ptr);
         return 0;
     }
 
     /* If oldptr is NULL, then this is just malloc. */
     if (ptr == NULL) {
-        return malloc(size);
+        return alloc_block(size);
     }
 
-    newptr = malloc(size);
+    newptr = alloc_block(size);
 
     /* If realloc() fails the original block is left untouched  */
     if (!newptr) {
         return 0;
     }
 
-    /* Copy the old data. */
-    oldsize = GET_SIZE(HDRP(ptr));
+    /* Copy the old data: its payload, not its header and footer */
+    oldsize = mm_usable_size(ptr);
     if (size < oldsize) oldsize = size;
     memcpy(newptr, ptr, oldsize);
 
     /* Free the old block. */
-    free(ptr);
+    free_block(ptr);
 
     return newptr;
 }
 
 /*
- * mm_checkheap - Check the heap for correctness. Helpful hint: You
- *                can call this function using mm_checkheap(__LINE__);
- *                to identify the line number of the call site.
+ * heap_growth - Bytes to extend the heap by for a block of asize bytes:
+ *     at least chunksize and, if grow, the growth percent of the heap,
+ *     rounded up so that the heap ends on a multiple of align bytes
+ */
+static size_t heap_growth(size_t asize, int grow)
+{
+    size_t heapsize = heap_top + WSIZE;
+    size_t size = MAX(asize, cfg.chunksize);
+
+    if (grow && cfg.growth > 0)
+        size = MAX(size, ALIGN(heapsize / 100 * cfg.growth));
+    if (cfg.align > 0)
+        size += (cfg.align - (heapsize + size) % cfg.align) % cfg.align;
+    return size;
+}
+
+/*
+ * mm_checkheap - Check the heap in time linear in its size, printing
+ *     only what is wrong, and without writing to it. One pass over the
+ *     blocks checks their sizes, that each header matches its footer
+ *     and that no two free blocks are neighbours, and counts the free
+ *     ones. A pass over the free lists then checks the links both ways
+ *     and that each listed block is a free one of the list's class.
+ *     Since a block has one class and one next link, a block listed
+ *     twice makes its list loop, so each walk stops once it has seen
+ *     more blocks than are free; and as every listed block is free, the
+ *     lists hold them all only if the counts agree.
+ *     Helpful hint: call it as mm_checkheap(__LINE__) to tell the
+ *     call sites apart.
  */
-int * gethead(int i){
-    if(i == 1)
-        return &free_head1;
-    if(i == 2)
-        return &free_head2;
-    if(i == 3)
-        return &free_head3;
-    if(i == 4)
-        return &free_head4;
-    if(i == 5)
-        return &free_head5;
-    if(i == 6)
-        return &free_head6;
-    if(i == 7)
-        return &free_head7;
-    if(i == 8)
-        return &free_head8;
-    if(i == 9)
-        return &free_head9;
-    if(i == 10)
-        return &free_head10;
-    if(i == 11)
-        return &free_head11;
-    if(i == 12)
-        return &free_head12;
-    if(i == 13)
-        return &free_head13;
-    if(i == 14)
-        return &free_head14;
-    return NULL;
+static void heap_error(int lineno, char* bp, const char* what) {
+    if (bp == NULL)
+        printf("mm_checkheap(%d): %s\n", lineno, what);
+    else
+        printf("mm_checkheap(%d): block %ld: %s\n", lineno,
+               (long)(bp - heap_listp), what);
+}
+
+/*
+ * in_list - Is bp in the free list of class i? Only used to name the
+ *     blocks the lists missed, so at most limit links are followed.
+ */
+static int in_list(char* bp, int i, size_t limit) {
+    char* p;
+
+    if (free_heads[i] == 0)
+        return 0;
+    for (p = heap_listp + free_heads[i]; limit-- > 0 && in_heap(p); p = SNRP(p)) {
+        if (p == bp)
+            return 1;
+        if (*(int*)(p) == 0)
+            break;
+    }
+    return 0;
 }
+
 void mm_checkheap(int lineno){
-    printf("call mm_checkheap in line: %d\n", lineno);
     char* bp;
-    for(int i = 1; i <= 14; i++){
-        int free_head = *gethead(i);
-        if(free_head != 0){
-	        for (bp = heap_listp + free_head1; ; bp = SNRP(bp)) {
-                if(!in_heap(bp)){
-                    printf("pointer %ld not in heap\n", bp - heap_listp);
+    char* next;
+    char* end;
+    size_t size, chain_blocks = 0, chain_bytes = 0, listed = 0, n;
+    int prev_free = 0;
+    int i;
+
+    if (heap_listp == 0)
+        return;
+    end = heap_listp - WSIZE + heap_top;  /* the epilogue header */
+    if (GET(heap_listp - WSIZE) != PACK(3 * WSIZE, 1) ||
+        GET(heap_listp + WSIZE) != PACK(3 * WSIZE, 1))
+        heap_error(lineno, heap_listp, "bad prologue");
+
+    /* The blocks, in address order */
+    for (bp = heap_listp + 3 * WSIZE; HDRP(bp) < end; bp = NEXT_BLKP(bp)) {
+        size = GET_SIZE(HDRP(bp));
+        if (size < 2 * DSIZE || size % ALIGNMENT != 0 || HDRP(bp) + size > end) {
+            heap_error(lineno, bp, "bad size");
+            break;
+        }
+        if (!aligned(bp))
+            heap_error(lineno, bp, "payload not aligned");
+        if (GET(HDRP(bp)) != GET(FTRP(bp)))
+            heap_error(lineno, bp, "header and footer differ");
+        if (GET_ALLOC(HDRP(bp))) {
+            prev_free = 0;
+            continue;
+        }
+        if (prev_free)
+            heap_error(lineno, bp, "free, and so is the block before it");
+        prev_free = 1;
+        chain_blocks++;
+        chain_bytes += size;
+    }
+    if (HDRP(bp) == end && GET(end) != PACK(0, 1))
+        heap_error(lineno, bp, "bad epilogue");
+    if (chain_bytes != free_bytes)
+        heap_error(lineno, NULL, "free bytes don't add up");
+
+    /* The free lists */
+    for (i = 0; i < cfg.nclasses; i++) {
+        n = 0;
+        if (free_heads[i] != 0) {
+            bp = heap_listp + free_heads[i];
+            if (in_heap(bp) && FARP(bp) != bp)
+                heap_error(lineno, bp, "first in its list, but has a predecessor");
+            for (;;) {
+                if (!in_heap(bp) || !aligned(bp)) {
+                    heap_error(lineno, bp, "list points outside the heap");
                     break;
                 }
-                if (!aligned(bp)) {
-                    printf("pointer %ld not aligned\n", bp - heap_listp);
+                size = GET_SIZE(HDRP(bp));
+                if (GET_ALLOC(HDRP(bp)) || size < 2 * DSIZE ||
+                    HDRP(bp) + size > end || GET(HDRP(bp)) != GET(FTRP(bp))) {
+                    heap_error(lineno, bp, "listed, but not a free block");
                     break;
                 }
-                printf("free_head%d: bp is %ld, size is %u\n", i, bp - heap_listp, GET_SIZE(HDRP(bp)));
-                if ((*(int*)(bp) == 0))
+                if (++n > chain_blocks) {
+                    heap_error(lineno, bp, "list loops, or lists a block twice");
                     break;
+                }
+                if (getclass(size) != i)
+                    heap_error(lineno, bp, "in the wrong list for its size");
+                if (*(int*)(bp) == 0)
+                    break;
+                next = SNRP(bp);
+                if (in_heap(next) && FARP(next) != bp)
+                    heap_error(lineno, next, "predecessor doesn't match the list");
+                bp = next;
             }
         }
+        if (n != counters.class_blocks[i])
+            heap_error(lineno, NULL, "a list's length doesn't match its counter");
+        listed += n;
+    }
+
+    /* Some free blocks are missing from the lists: find which */
+    if (listed < chain_blocks) {
+        for (bp = heap_listp + 3 * WSIZE; HDRP(bp) < end; bp = NEXT_BLKP(bp)) {
+            size = GET_SIZE(HDRP(bp));
+            if (size < 2 * DSIZE || HDRP(bp) + size > end)
+                break;
+            if (!GET_ALLOC(HDRP(bp)) &&
+                !in_list(bp, getclass(size), chain_blocks))
+                heap_error(lineno, bp, "free, but in no list");
+        }
     }
 }
 
@@ -337,18 +918,23 @@ static void* extend_heap(size_t words)
 {
     char* bp;
     size_t size;
+    PHASE_BEGIN(MM_EXTEND_HEAP);
 
-    /* Allocate an even number of words to maintain alignment */
-    size = (words % 2) ? (words + 1) * WSIZE : words * WSIZE;
+    /* Allocate a multiple of ALIGNMENT to maintain alignment */
+    size = ALIGN(words * WSIZE);
     if ((long)(bp = mem_sbrk(size)) == -1){
+        PHASE_END();
         return NULL;}
+    counters.sbrk_calls++;
     heap_top += size;
     /* Initialize free block header/footer and the epilogue header */
     PUT(HDRP(bp), PACK(size, 0));         /* Free block header */
     PUT(FTRP(bp), PACK(size, 0));         /* Free block footer */
     PUT(HDRP(NEXT_BLKP(bp)), PACK(0, 1)); /* New epilogue header */
     /* Coalesce if the previous block was free */
-    return coalesce(bp);
+    bp = coalesce(bp);
+    PHASE_END();
+    return bp;
 }
 
 /*
@@ -358,6 +944,9 @@ static void delete_block(void* bp) {
     int* free_head = getfree_head(GET_SIZE(HDRP(bp)));
     char* next = SNRP(bp);
     char* prev = FARP(bp);
+    free_bytes -= GET_SIZE(HDRP(bp));
+    counters.class_blocks[free_head - free_heads]--;
+    counters.class_bytes[free_head - free_heads] -= GET_SIZE(HDRP(bp));
     if (next == prev) {
         *free_head = 0;
         return;
@@ -410,6 +999,10 @@ static void add_block(void* bp) {
         }
     }*/
     
+    free_bytes += GET_SIZE(HDRP(bp));
+    freed_class = free_head - free_heads;
+    counters.class_blocks[free_head - free_heads]++;
+    counters.class_bytes[free_head - free_heads] += GET_SIZE(HDRP(bp));
     if (*free_head != 0) {
         char* next = (char*)(heap_listp) + *free_head;
         *(int*)((char*)(next) + WSIZE) = (char*)(bp)-next;
@@ -423,6 +1016,7 @@ static void add_block(void* bp) {
 }
 static void* coalesce(void* bp)
 {
+    PHASE_BEGIN(MM_COALESCE);
     char* prev_bp = PREV_BLKP(bp);
 	char* next_bp = NEXT_BLKP(bp);
     size_t prev_alloc;
@@ -438,7 +1032,7 @@ static void* coalesce(void* bp)
     size_t size = GET_SIZE(HDRP(bp));
     if (prev_alloc && next_alloc) {            /* Case 1 */
 		add_block(bp);
-        return bp;
+        INSTR(mm_instr.coalesce_case[0]++);
     }
 
     else if (prev_alloc && !next_alloc) {      /* Case 2 */
@@ -448,6 +1042,8 @@ static void* coalesce(void* bp)
         PUT(HDRP(bp), PACK(size, 0));
         PUT(FTRP(bp), PACK(size, 0));
         add_block(bp);
+        counters.coalesces++;
+        INSTR(mm_instr.coalesce_case[1]++);
     }
 
     else if (!prev_alloc && next_alloc) {      /* Case 3 */
@@ -458,6 +1054,8 @@ static void* coalesce(void* bp)
         PUT(FTRP(lp), PACK(size, 0));
         add_block(lp);
         bp = lp;
+        counters.coalesces++;
+        INSTR(mm_instr.coalesce_case[2]++);
     }
 
     else {                                     /* Case 4 */
@@ -470,7 +1068,10 @@ static void* coalesce(void* bp)
         PUT(FTRP(lp), PACK(size, 0));
         add_block(lp);
         bp = lp;
+        counters.coalesces += 2;
+        INSTR(mm_instr.coalesce_case[3]++);
     }
+    PHASE_END();
     return bp;
 }
 
@@ -480,20 +1081,24 @@ static void* coalesce(void* bp)
  */
 static void place(void* bp, size_t asize)
 {
+    PHASE_BEGIN(MM_PLACE);
     size_t csize = GET_SIZE(HDRP(bp));
     delete_block(bp);
-    if ((csize - asize) >= (2 * DSIZE)) {
+    if ((csize - asize) >= cfg.split_min) {
         PUT(HDRP(bp), PACK(asize, 1));
         PUT(FTRP(bp), PACK(asize, 1));
         char* rp = NEXT_BLKP(bp);
         PUT(HDRP(rp), PACK(csize - asize, 0));
         PUT(FTRP(rp), PACK(csize - asize, 0));
+        counters.splits++;
+        INSTR(mm_instr.splits++);
 		coalesce(rp);
     }
     else {
         PUT(HDRP(bp), PACK(csize, 1));
         PUT(FTRP(bp), PACK(csize, 1));
     }
+    PHASE_END();
 }
 
 /*
@@ -503,133 +1108,41 @@ static void* find_fit(size_t asize)
 {   
     if (asize < 2 * DSIZE)
         return NULL;
+    PHASE_BEGIN(MM_FIND_FIT);
+    unsigned nodes = 0;
     char* bp;
-    if (asize <= 28 && free_head1 != 0) {
-        for (bp = heap_listp + free_head1; ; bp = SNRP(bp)) {
+    char* best = NULL;
+    /* First-fit search of the lists that can hold a big enough block.
+       For best fit, the first list with a fit is searched to the end
+       (or an exact fit): later lists only hold bigger blocks. */
+    for (int i = getclass(asize); i < cfg.nclasses; i++) {
+        if (free_heads[i] == 0)
+            continue;
+        for (bp = heap_listp + free_heads[i]; ; bp = SNRP(bp)) {
+            nodes++;
             if (asize <= GET_SIZE(HDRP(bp))) {
-                return bp;
-            }
-            if ((*(int*)(bp) == 0))
-                break;
-        }
-    }
-    if (asize <= 64 && free_head2 != 0) {
-        for (bp = heap_listp + free_head2; ; bp = SNRP(bp)) {
-            if (asize <= GET_SIZE(HDRP(bp))) {
-                return bp;
-            }
-            if ((*(int*)(bp) == 0))
-                break;
-        }
-    }
-    if (asize <= 96 && free_head3 != 0) {
-        for (bp = heap_listp + free_head3; ; bp = SNRP(bp)) {
-            if (asize <= GET_SIZE(HDRP(bp))) {
-                return bp;
-            }
-            if ((*(int*)(bp) == 0))
-                break;
-        }
-    }
-    if (asize <= 128 && free_head4 != 0) {
-        for (bp = heap_listp + free_head4; ; bp = SNRP(bp)) {
-            if (asize <= GET_SIZE(HDRP(bp))) {
-                return bp;
-            }
-            if ((*(int*)(bp) == 0))
-                break;
-        }
-    }
-    if (asize <= 192 && free_head5 != 0) {
-        for (bp = heap_listp + free_head5; ; bp = SNRP(bp)) {
-            if (asize <= GET_SIZE(HDRP(bp))) {
-                return bp;
-            }
-            if ((*(int*)(bp) == 0))
-                break;
-        }
-    }
-    if (asize <= 256 && free_head6 != 0) {
-        for (bp = heap_listp + free_head6; ; bp = SNRP(bp)) {
-            if (asize <= GET_SIZE(HDRP(bp))) {
-                return bp;
-            }
-            if ((*(int*)(bp) == 0))
-                break;
-        }
-    }
-    if (asize <= 384 && free_head7 != 0) {
-        for (bp = heap_listp + free_head7; ; bp = SNRP(bp)) {
-            if (asize <= GET_SIZE(HDRP(bp))) {
-                return bp;
-            }
-            if ((*(int*)(bp) == 0))
-                break;
-        }
-    }
-    if (asize <= 512 && free_head8 != 0) {
-        for (bp = heap_listp + free_head8; ; bp = SNRP(bp)) {
-            if (asize <= GET_SIZE(HDRP(bp))) {
-                return bp;
-            }
-            if ((*(int*)(bp) == 0))
-                break;
-        }
-    }
-    if (asize <= 768 && free_head9 != 0) {
-        for (bp = heap_listp + free_head9; ; bp = SNRP(bp)) {
-            if (asize <= GET_SIZE(HDRP(bp))) {
-                return bp;
-            }
-            if ((*(int*)(bp) == 0))
-                break;
-        }
-    }
-    if (asize <= 1024 && free_head10 != 0) {
-        for (bp = heap_listp + free_head10; ; bp = SNRP(bp)) {
-            if (asize <= GET_SIZE(HDRP(bp))) {
-                return bp;
-            }
-            if ((*(int*)(bp) == 0))
-                break;
-        }
-    }
-    if (asize <= 1536 && free_head11 != 0) {
-        for (bp = heap_listp + free_head11; ; bp = SNRP(bp)) {
-            if (asize <= GET_SIZE(HDRP(bp))) {
-                return bp;
-            }
-            if ((*(int*)(bp) == 0))
-                break;
-        }
-    }
-    if (asize <= 2048 && free_head12 != 0) {
-        for (bp = heap_listp + free_head12; ; bp = SNRP(bp)) {
-            if (asize <= GET_SIZE(HDRP(bp))) {
-                return bp;
-            }
-            if ((*(int*)(bp) == 0))
-                break;
-        }
-    }
-    if (asize <= 4096 && free_head13 != 0) {
-        for (bp = heap_listp + free_head13; ; bp = SNRP(bp)) {
-            if (asize <= GET_SIZE(HDRP(bp))) {
-                return bp;
+                if (!cfg.best_fit) {
+                    best = bp;
+                    break;
+                }
+                if (best == NULL || GET_SIZE(HDRP(bp)) < GET_SIZE(HDRP(best)))
+                    best = bp;
+                if (GET_SIZE(HDRP(bp)) == asize)
+                    break;
             }
             if ((*(int*)(bp) == 0))
                 break;
         }
-    }
-    if (free_head14 != 0) {
-        for (bp = heap_listp + free_head14; ; bp = SNRP(bp)) {
-            if (asize <= GET_SIZE(HDRP(bp))) {
-                return bp;
-            }
-            if ((*(int*)(bp) == 0))
-                break;
+        if (best != NULL) {
+            served_class = i;
+            fit_search = nodes;
+            INSTR(instr_search(nodes));
+            PHASE_END();
+            return best;
         }
     }
-    /* First-fit search */
+    fit_search = nodes;
+    INSTR(instr_search(nodes));
+    PHASE_END();
     return NULL; /* No fit */
 }
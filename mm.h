@@ -20,5 +20,58 @@ extern void *calloc (size_t nmemb, size_t size);
 
 extern int mm_init(void);
 
+/* How much of a block the caller may use, and how much of the heap is
+   sitting in free blocks; the driver uses these to break down waste. */
+extern size_t mm_usable_size(void *ptr);
+extern size_t mm_free_bytes(void);
+
+/* A snapshot of the package's counters, filled in by mm_stats() */
+#define MM_MAXCLASSES 32
+typedef struct mm_stats_t {
+    int nclasses;                       /* number of free lists */
+    size_t class_blocks[MM_MAXCLASSES]; /* free blocks in each list */
+    size_t class_bytes[MM_MAXCLASSES];  /* and their total size */
+    size_t largest_free;                /* size of the largest free block */
+    size_t alloc_bytes;                 /* allocated blocks, headers included */
+    size_t free_bytes;                  /* free blocks, headers included */
+    size_t heapsize;                    /* bytes obtained with mem_sbrk */
+    unsigned long sbrk_calls;           /* number of mem_sbrk calls */
+    unsigned long splits;               /* free blocks split by a request */
+    unsigned long coalesces;            /* free neighbours merged on free */
+} mm_stats_t;
+extern void mm_stats(mm_stats_t *stats);
+
+/* Call fn for every block of the heap, in address order, with the
+   offset of its header from the start of the heap, its size, and
+   whether it is allocated */
+typedef void (*mm_walk_fn)(size_t offset, size_t size, int alloc, void *arg);
+extern void mm_heap_walk(mm_walk_fn fn, void *arg);
+
+#ifdef MM_INSTRUMENT
+/*
+ * Where mm.c spends its time, recorded only when it is built with
+ * -DMM_INSTRUMENT ("make instr"). mm_init clears it.
+ */
+#define MM_SEARCH_BUCKETS 16  /* nodes visited: 0, 1, 2-3, 4-7, ... */
+enum { MM_FIND_FIT, MM_PLACE, MM_COALESCE, MM_EXTEND_HEAP, MM_NPHASES };
+typedef struct {
+    unsigned long search_hist[MM_SEARCH_BUCKETS]; /* find_fit calls by
+                                                     nodes visited */
+    unsigned long nodes;                          /* total nodes visited */
+    unsigned long class_served[MM_MAXCLASSES];    /* requests served from
+                                                     each free list */
+    unsigned long heap_served;                    /* and by extend_heap */
+    unsigned long coalesce_case[4];               /* coalesce() cases 1-4 */
+    unsigned long splits;                         /* place() calls that split */
+    unsigned long calls[MM_NPHASES];              /* calls to each phase */
+    unsigned long long cycles[MM_NPHASES];        /* cycles spent in each,
+                                                     less its callees */
+} mm_instr_t;
+extern mm_instr_t mm_instr;
+#endif
+
+/* Set a tunable parameter of the package by name; 0 if it took */
+extern int mm_setparam(const char *name, const char *value);
+
 /* This is largely for debugging. */
 extern void mm_checkheap(int lineno);
@@ -0,0 +1,171 @@
+/*
+ * mmstat.c - Watch the counters a process running on libmm.so publishes
+ *
+ * The process has to be started with MM_STATS set (see statpage.h);
+ * mmstat then prints a line every interval for as long as it runs:
+ *
+ *     unix> LD_PRELOAD=./libmm.so MM_STATS=1 ./server &
+ *     unix> ./mmstat -v -i 5 $!
+ *
+ * The request rates are computed from the change in the request
+ * counts since the previous line.
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+
+#include "mm.h"
+#include "statpage.h"
+
+static void usage(void)
+{
+    fprintf(stderr, "Usage: mmstat [-hv] [-i <secs>] [-c <count>] <pid>\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-c <count> Stop after count lines.\n");
+    fprintf(stderr, "\t-h         Print this message.\n");
+    fprintf(stderr, "\t-i <secs>  Print a line every secs seconds (default 1).\n");
+    fprintf(stderr, "\t-v         Also print the free blocks in each list.\n");
+}
+
+/*
+ * snapshot - Copy the page without stopping its writer: retry while
+ *     seq is odd or moves under us. Gives up if the writer seems to
+ *     have died halfway through.
+ */
+static int snapshot(const statpage_t *page, statpage_t *copy)
+{
+    uint32_t before, after;
+    int tries;
+
+    for (tries = 0; tries < 100000; tries++) {
+        before = __atomic_load_n(&page->seq, __ATOMIC_ACQUIRE);
+        if (before & 1)
+            continue;
+        memcpy(copy, page, sizeof(*copy));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        after = __atomic_load_n(&page->seq, __ATOMIC_RELAXED);
+        if (before == after)
+            return 0;
+    }
+    return -1;
+}
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv)
+{
+    int c, i, fd, pid, n;
+    int verbose = 0, count = -1;
+    double interval = 1, start, t, dt, last_t;
+    size_t blocks;
+    char name[32];
+    statpage_t *page, cur, prev;
+    struct timespec nap;
+
+    while ((c = getopt(argc, argv, "c:hi:v")) != EOF) {
+        switch (c) {
+        case 'c':
+            count = atoi(optarg);
+            break;
+        case 'i':
+            interval = atof(optarg);
+            break;
+        case 'v':
+            verbose = 1;
+            break;
+        case 'h':
+            usage();
+            exit(0);
+        default:
+            usage();
+            exit(1);
+        }
+    }
+    if (optind != argc - 1 || (pid = atoi(argv[optind])) <= 0 || interval <= 0) {
+        usage();
+        exit(1);
+    }
+
+    snprintf(name, sizeof(name), STATPAGE_NAME, pid);
+    if ((fd = shm_open(name, O_RDONLY, 0)) < 0) {
+        fprintf(stderr, "mmstat: no %s; is process %d running on libmm.so "
+                "with MM_STATS set?\n", name, pid);
+        exit(1);
+    }
+    page = mmap(NULL, sizeof(statpage_t), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (page == MAP_FAILED) {
+        fprintf(stderr, "mmstat: cannot map %s\n", name);
+        exit(1);
+    }
+    if (memcmp(page->magic, STATPAGE_MAGIC, sizeof(STATPAGE_MAGIC)) != 0 ||
+        page->version != STATPAGE_VERSION || page->size != sizeof(statpage_t)) {
+        fprintf(stderr, "mmstat: %s is not a version %d stats page\n",
+                name, STATPAGE_VERSION);
+        exit(1);
+    }
+
+    nap.tv_sec = (time_t)interval;
+    nap.tv_nsec = (long)((interval - nap.tv_sec) * 1e9);
+    start = last_t = now();
+    if (snapshot(page, &prev) < 0) {
+        fprintf(stderr, "mmstat: %s is stuck halfway through an update\n", name);
+        exit(1);
+    }
+    printf("%7s %9s %9s %9s %7s %5s %5s %9s %9s %9s %6s\n", "time",
+           "heap KB", "alloc KB", "free KB", "blocks", "util", "frag",
+           "malloc/s", "free/s", "realloc/s", "sbrk");
+    for (n = 0; count < 0 || n < count; n++) {
+        nanosleep(&nap, NULL);
+        if (kill(pid, 0) < 0 && errno == ESRCH) {
+            printf("mmstat: process %d has exited\n", pid);
+            break;
+        }
+        if (snapshot(page, &cur) < 0) {
+            fprintf(stderr, "mmstat: %s is stuck halfway through an update\n",
+                    name);
+            exit(1);
+        }
+        t = now();
+        dt = t - last_t;
+
+        blocks = 0;
+        for (i = 0; i < cur.stats.nclasses; i++)
+            blocks += cur.stats.class_blocks[i];
+        printf("%7.1f %9zu %9zu %9zu %7zu %4.0f%% %5.2f %9.0f %9.0f %9.0f %6lu\n",
+               t - start, cur.stats.heapsize / 1024,
+               cur.stats.alloc_bytes / 1024, cur.stats.free_bytes / 1024,
+               blocks, cur.stats.heapsize ?
+               100.0 * cur.stats.alloc_bytes / cur.stats.heapsize : 0,
+               cur.frag,
+               (cur.ops[SP_MALLOC] - prev.ops[SP_MALLOC]) / dt,
+               (cur.ops[SP_FREE] - prev.ops[SP_FREE]) / dt,
+               (cur.ops[SP_REALLOC] - prev.ops[SP_REALLOC]) / dt,
+               cur.stats.sbrk_calls);
+        if (verbose) {
+            for (i = 0; i < cur.stats.nclasses; i++)
+                if (cur.stats.class_blocks[i] > 0)
+                    printf("%17s %2d: %7zu blocks %9zu KB\n", "list", i,
+                           cur.stats.class_blocks[i],
+                           cur.stats.class_bytes[i] / 1024);
+        }
+        fflush(stdout);
+        prev = cur;
+        last_t = t;
+    }
+    munmap(page, sizeof(statpage_t));
+    return 0;
+}
@@ -0,0 +1,392 @@
+/*
+ * mmtune.c - Search mm.c's tunable parameters against the traces
+ *
+ * Runs mdriver over and over with different settings of the parameters
+ * that mm_setparam() knows about (the free-list class limits, the
+ * chunk size the heap grows by and the smallest remainder place()
+ * splits off), scoring each setting by the perf index mdriver reports.
+ * By default it hill-climbs: every round tries as many variations of
+ * the best setting so far as there are jobs, in parallel. With -r it
+ * samples settings at random instead.
+ *
+ * Arguments after the options are passed on to mdriver, e.g.
+ *
+ *     unix> ./mmtune -n 20 -- -t traces/
+ *
+ * When the search ends, mmtune prints the best setting as mdriver -C
+ * flags and compares it trace by trace with mm.c's defaults.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#define MAXCLASSES 32
+#define MAXJOBS    64
+#define MAXTRACES  256
+#define MAXLINE    1024
+
+/* One setting of the parameters */
+typedef struct {
+    int nlimits;                    /* number of class limits */
+    unsigned long limit[MAXCLASSES];
+    unsigned long chunksize;
+    unsigned long split;
+} param_t;
+
+/* What mdriver reported for one setting */
+typedef struct {
+    int ok;                         /* did mdriver run to the end? */
+    double perfindex;
+    double util;
+    int ntraces;
+    char trace[MAXTRACES][MAXLINE];
+    double trace_util[MAXTRACES];
+    double trace_kops[MAXTRACES];
+} score_t;
+
+/* mm.c's defaults; keep in step with cfg there */
+static const param_t defaults = {
+    13, { 28, 64, 96, 128, 192, 256, 384, 512, 768, 1024, 1536, 2048, 4096 },
+    1 << 10, 16
+};
+
+static const char *mdriver = "./mdriver";
+static char **driver_args;
+static int ndriver_args;
+
+static unsigned long long rng_state = 88172645463325252ULL;
+
+/* rng - xorshift64*; returns a number in [0, n) */
+static unsigned long rng(unsigned long n)
+{
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return (unsigned long)((rng_state * 2685821657736338717ULL) >> 32) % n;
+}
+
+/* format_classes - The class limits as mm_setparam wants them */
+static void format_classes(const param_t *p, char *buf, size_t len)
+{
+    int i, n = 0;
+
+    buf[0] = '\0';
+    for (i = 0; i < p->nlimits && n < (int)len; i++)
+        n += snprintf(buf + n, len - n, "%s%lu", i ? "," : "", p->limit[i]);
+}
+
+static void print_param(FILE *fp, const param_t *p)
+{
+    char classes[MAXLINE];
+
+    format_classes(p, classes, sizeof(classes));
+    fprintf(fp, "-C classes=%s -C chunksize=%lu -C split=%lu",
+            classes, p->chunksize, p->split);
+}
+
+/*
+ * start_run - Start mdriver on setting p, writing its report to
+ *     outfile. Returns the child's pid.
+ */
+static pid_t start_run(const param_t *p, const char *outfile)
+{
+    char classes[MAXLINE], chunk[64], split[64];
+    char *argv[16 + MAXLINE];
+    int argc = 0, i, fd;
+    pid_t pid;
+
+    if ((pid = fork()) != 0) {
+        if (pid < 0) {
+            perror("mmtune: fork");
+            exit(1);
+        }
+        return pid;
+    }
+
+    strcpy(classes, "classes=");
+    format_classes(p, classes + 8, sizeof(classes) - 8);
+    snprintf(chunk, sizeof(chunk), "chunksize=%lu", p->chunksize);
+    snprintf(split, sizeof(split), "split=%lu", p->split);
+
+    argv[argc++] = (char *)mdriver;
+    argv[argc++] = "-C";
+    argv[argc++] = classes;
+    argv[argc++] = "-C";
+    argv[argc++] = chunk;
+    argv[argc++] = "-C";
+    argv[argc++] = split;
+    argv[argc++] = "-o";
+    argv[argc++] = (char *)outfile;
+    for (i = 0; i < ndriver_args && argc < 15 + MAXLINE; i++)
+        argv[argc++] = driver_args[i];
+    argv[argc] = NULL;
+
+    /* mdriver's own output would only get in the way */
+    if ((fd = open("/dev/null", O_WRONLY)) >= 0) {
+        dup2(fd, STDOUT_FILENO);
+        dup2(fd, STDERR_FILENO);
+        close(fd);
+    }
+    execv(mdriver, argv);
+    _exit(127);
+}
+
+/* json_number - The number after "key": in line, or def if missing */
+static double json_number(const char *line, const char *key, double def)
+{
+    char pat[64];
+    const char *s;
+
+    snprintf(pat, sizeof(pat), "\"%s\":", key);
+    if ((s = strstr(line, pat)) == NULL)
+        return def;
+    return atof(s + strlen(pat));
+}
+
+/*
+ * read_score - Read the report mdriver wrote (one trace per line)
+ */
+static void read_score(const char *outfile, score_t *sc)
+{
+    FILE *fp;
+    char line[4 * MAXLINE];
+    const char *s, *e;
+
+    sc->ok = 0;
+    sc->ntraces = 0;
+    if ((fp = fopen(outfile, "r")) == NULL)
+        return;
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        if (strstr(line, "\"perfindex\":") != NULL) {
+            sc->perfindex = json_number(line, "perfindex", 0);
+            sc->ok = 1;
+        } else if (strstr(line, "\"util\":") != NULL &&
+                   strstr(line, "\"trace\":") == NULL) {
+            sc->util = json_number(line, "util", 0);
+        } else if ((s = strstr(line, "\"trace\": \"")) != NULL &&
+                   sc->ntraces < MAXTRACES) {
+            s += 10;
+            if ((e = strchr(s, '"')) == NULL)
+                continue;
+            snprintf(sc->trace[sc->ntraces], MAXLINE, "%.*s", (int)(e - s), s);
+            sc->trace_util[sc->ntraces] = json_number(line, "util", 0);
+            sc->trace_kops[sc->ntraces] = json_number(line, "kops", 0);
+            if (json_number(line, "valid", 0) == 0)
+                sc->ok = 0;
+            sc->ntraces++;
+        }
+    }
+    fclose(fp);
+    unlink(outfile);
+}
+
+/*
+ * evaluate - Run mdriver on the n settings p[], up to n at a time,
+ *     and fill in their scores
+ */
+static void evaluate(const param_t *p, score_t *sc, int n)
+{
+    char outfile[n][64];
+    pid_t pid[MAXJOBS];
+    int i, status;
+
+    for (i = 0; i < n; i++) {
+        snprintf(outfile[i], sizeof(outfile[i]), "/tmp/mmtune.%d.%d.json",
+                 (int)getpid(), i);
+        pid[i] = start_run(&p[i], outfile[i]);
+    }
+    for (i = 0; i < n; i++) {
+        if (waitpid(pid[i], &status, 0) < 0)
+            status = -1;
+        read_score(outfile[i], &sc[i]);
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+            sc[i].ok = 0;
+    }
+}
+
+/* better - Does score a beat score b? Ties on perf index go to util. */
+static int better(const score_t *a, const score_t *b)
+{
+    if (!a->ok)
+        return 0;
+    if (!b->ok)
+        return 1;
+    if (a->perfindex != b->perfindex)
+        return a->perfindex > b->perfindex;
+    return a->util > b->util;
+}
+
+/*
+ * mutate - Change one thing about setting p: move, add or drop a class
+ *     limit, or double or halve the chunk size, or move the split
+ *     threshold by a word
+ */
+static void mutate(param_t *p)
+{
+    int i, k;
+    unsigned long lo, hi;
+
+    switch (rng(6)) {
+    case 0:
+    case 1: /* move a limit between its neighbours */
+        i = rng(p->nlimits);
+        lo = (i > 0) ? p->limit[i - 1] + 8 : 16;
+        hi = (i < p->nlimits - 1) ? p->limit[i + 1] - 8 : p->limit[i] * 2;
+        if (lo < hi) {
+            p->limit[i] = (lo + rng(hi - lo + 1)) & ~7UL;
+            if (p->limit[i] < lo)
+                p->limit[i] += 8;
+        }
+        break;
+    case 2: /* split a class in two */
+        if (p->nlimits == MAXCLASSES - 1)
+            break;
+        i = rng(p->nlimits + 1);
+        lo = (i > 0) ? p->limit[i - 1] : 16;
+        hi = (i < p->nlimits) ? p->limit[i] : lo * 2;
+        if (hi - lo < 16)
+            break;
+        for (k = p->nlimits; k > i; k--)
+            p->limit[k] = p->limit[k - 1];
+        p->limit[i] = ((lo + hi) / 2) & ~7UL;
+        p->nlimits++;
+        break;
+    case 3: /* merge two classes */
+        if (p->nlimits <= 1)
+            break;
+        i = rng(p->nlimits);
+        for (k = i; k < p->nlimits - 1; k++)
+            p->limit[k] = p->limit[k + 1];
+        p->nlimits--;
+        break;
+    case 4:
+        if (rng(2) && p->chunksize < (1UL << 20))
+            p->chunksize *= 2;
+        else if (p->chunksize > 256)
+            p->chunksize /= 2;
+        break;
+    case 5:
+        if (rng(2))
+            p->split += 8;
+        else if (p->split > 16)
+            p->split -= 8;
+        break;
+    }
+}
+
+/* randomize - A setting drawn at random: limits spaced geometrically */
+static void randomize(param_t *p)
+{
+    unsigned long v = 16;
+    int n = 4 + rng(16);
+
+    p->nlimits = 0;
+    while (p->nlimits < n && v < 65536) {
+        v = (v + 8 + rng(v)) & ~7UL;
+        p->limit[p->nlimits++] = v;
+    }
+    p->chunksize = 256UL << rng(9);
+    p->split = 16 + 8 * rng(7);
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "Usage: mmtune [-hr] [-n <rounds>] [-j <jobs>] [-S <seed>] "
+            "[-m <mdriver>] [-- <mdriver args>]\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-h         Print this message.\n");
+    fprintf(stderr, "\t-j <n>     Run <n> candidates at once (default: one per CPU).\n");
+    fprintf(stderr, "\t-m <path>  Driver to run (default ./mdriver).\n");
+    fprintf(stderr, "\t-n <n>     Number of rounds (default 10).\n");
+    fprintf(stderr, "\t-r         Random search instead of hill climbing.\n");
+    fprintf(stderr, "\t-S <seed>  Seed for the random number generator.\n");
+}
+
+int main(int argc, char **argv)
+{
+    int c, i, r, rounds = 10, jobs = 0, random_search = 0;
+    param_t best_p, cand[MAXJOBS];
+    static score_t base, best, sc[MAXJOBS];
+
+    while ((c = getopt(argc, argv, "hrn:j:m:S:")) != EOF) {
+        switch (c) {
+        case 'r':
+            random_search = 1;
+            break;
+        case 'n':
+            rounds = atoi(optarg);
+            break;
+        case 'j':
+            jobs = atoi(optarg);
+            break;
+        case 'm':
+            mdriver = optarg;
+            break;
+        case 'S':
+            rng_state = strtoull(optarg, NULL, 0) * 0x9E3779B97F4A7C15ULL + 1;
+            break;
+        case 'h':
+            usage();
+            exit(0);
+        default:
+            usage();
+            exit(1);
+        }
+    }
+    driver_args = argv + optind;
+    ndriver_args = argc - optind;
+    if (jobs <= 0)
+        jobs = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (jobs < 1)
+        jobs = 1;
+    if (jobs > MAXJOBS)
+        jobs = MAXJOBS;
+
+    best_p = defaults;
+    evaluate(&best_p, &base, 1);
+    if (!base.ok) {
+        fprintf(stderr, "mmtune: %s failed with mm.c's default settings\n",
+                mdriver);
+        exit(1);
+    }
+    best = base;
+    printf("round %3d: perf index %6.2f, util %5.1f%%\n", 0,
+           base.perfindex, base.util * 100.0);
+
+    for (r = 1; r <= rounds; r++) {
+        for (i = 0; i < jobs; i++) {
+            cand[i] = best_p;
+            if (random_search)
+                randomize(&cand[i]);
+            else
+                mutate(&cand[i]);
+        }
+        evaluate(cand, sc, jobs);
+        for (i = 0; i < jobs; i++) {
+            if (better(&sc[i], &best)) {
+                best = sc[i];
+                best_p = cand[i];
+            }
+        }
+        printf("round %3d: perf index %6.2f, util %5.1f%%  ", r,
+               best.perfindex, best.util * 100.0);
+        print_param(stdout, &best_p);
+        printf("\n");
+        fflush(stdout);
+    }
+
+    printf("\nBest setting (perf index %.2f, was %.2f):\n  ",
+           best.perfindex, base.perfindex);
+    print_param(stdout, &best_p);
+    printf("\n\n%8s%8s%10s%10s  %s\n", "util", "was", "Kops", "was", "trace");
+    for (i = 0; i < best.ntraces && i < base.ntraces; i++)
+        printf("%7.1f%%%7.1f%%%10.0f%10.0f  %s\n",
+               best.trace_util[i] * 100.0, base.trace_util[i] * 100.0,
+               best.trace_kops[i], base.trace_kops[i], best.trace[i]);
+    return 0;
+}
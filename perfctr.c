@@ -0,0 +1,173 @@
+/*
+ * perfctr.c - Count hardware events with perf_event_open(2)
+ *
+ * The counters are opened once for the calling thread and then
+ * started and stopped around each measurement. Counters that the
+ * machine doesn't support are skipped; if none of the hardware events
+ * can be opened (e.g. in a VM or with a strict perf_event_paranoid)
+ * we use the kernel's software events, and if perf_event_open isn't
+ * usable at all we report what getrusage() knows.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#endif
+
+#include "perfctr.h"
+
+/* Which set of counters perfctr_init() managed to open */
+static enum { PC_NONE, PC_PERF, PC_RUSAGE } source = PC_NONE;
+
+static int fds[PERFCTR_MAX];
+static perfctr_t opened;             /* names of the counters in fds */
+static struct rusage ru_start;
+
+#ifdef __linux__
+
+/* A perf event and the column name we print it under */
+typedef struct {
+    const char *name;
+    unsigned type;
+    unsigned long long config;
+} event_t;
+
+#define CACHE_MISS(cache) \
+    ((cache) | (PERF_COUNT_HW_CACHE_OP_READ << 8) | \
+     (PERF_COUNT_HW_CACHE_RESULT_MISS << 16))
+
+static const event_t hw_events[] = {
+    { "instr",     PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    { "cycles",    PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    { "L1d-miss",  PERF_TYPE_HW_CACHE, CACHE_MISS(PERF_COUNT_HW_CACHE_L1D) },
+    { "LLC-miss",  PERF_TYPE_HW_CACHE, CACHE_MISS(PERF_COUNT_HW_CACHE_LL) },
+    { "dTLB-miss", PERF_TYPE_HW_CACHE, CACHE_MISS(PERF_COUNT_HW_CACHE_DTLB) },
+    { "br-miss",   PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+    { NULL, 0, 0 }
+};
+
+static const event_t sw_events[] = {
+    { "task-ns",   PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK },
+    { "pg-fault",  PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS },
+    { "ctx-sw",    PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES },
+    { "cpu-migr",  PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CPU_MIGRATIONS },
+    { NULL, 0, 0 }
+};
+
+/* Open one counter on the calling thread, user-space events only */
+static int open_event(const event_t *ev)
+{
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = ev->type;
+    attr.config = ev->config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED |
+        PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+/* Open every event in evs that the machine supports */
+static int open_events(const event_t *evs)
+{
+    int fd;
+
+    opened.n = 0;
+    for (; evs->name != NULL && opened.n < PERFCTR_MAX; evs++) {
+        if ((fd = open_event(evs)) < 0)
+            continue;
+        fds[opened.n] = fd;
+        opened.name[opened.n] = evs->name;
+        opened.n++;
+    }
+    return opened.n;
+}
+
+#endif /* __linux__ */
+
+/*
+ * perfctr_init - Open the counters and say which kind we got
+ */
+const char *perfctr_init(void)
+{
+#ifdef __linux__
+    if (source == PC_NONE && open_events(hw_events) > 0) {
+        source = PC_PERF;
+        return "hardware counters";
+    }
+    if (source == PC_NONE && open_events(sw_events) > 0) {
+        source = PC_PERF;
+        return "software counters (no hardware counters available)";
+    }
+#endif
+    if (source == PC_NONE) {
+        source = PC_RUSAGE;
+        opened.n = 4;
+        opened.name[0] = "minflt";
+        opened.name[1] = "majflt";
+        opened.name[2] = "vol-csw";
+        opened.name[3] = "invol-csw";
+        return "getrusage (perf_event_open unavailable)";
+    }
+    return source == PC_PERF ? "perf_event_open counters" : "getrusage";
+}
+
+/*
+ * perfctr_start - Reset and start the counters
+ */
+void perfctr_start(void)
+{
+#ifdef __linux__
+    if (source == PC_PERF) {
+        int i;
+
+        for (i = 0; i < opened.n; i++) {
+            ioctl(fds[i], PERF_EVENT_IOC_RESET, 0);
+            ioctl(fds[i], PERF_EVENT_IOC_ENABLE, 0);
+        }
+        return;
+    }
+#endif
+    getrusage(RUSAGE_SELF, &ru_start);
+}
+
+/*
+ * perfctr_stop - Stop the counters and read them, scaling each value up
+ *     if the kernel had to multiplex it with other counters
+ */
+void perfctr_stop(perfctr_t *res)
+{
+    struct rusage ru;
+
+    *res = opened;
+#ifdef __linux__
+    if (source == PC_PERF) {
+        unsigned long long buf[3]; /* value, time enabled, time running */
+        int i;
+
+        for (i = 0; i < opened.n; i++)
+            ioctl(fds[i], PERF_EVENT_IOC_DISABLE, 0);
+        for (i = 0; i < opened.n; i++) {
+            res->value[i] = 0;
+            if (read(fds[i], buf, sizeof(buf)) != sizeof(buf) || buf[2] == 0)
+                continue;
+            res->value[i] = (double)buf[0] * buf[1] / buf[2];
+        }
+        return;
+    }
+#endif
+    getrusage(RUSAGE_SELF, &ru);
+    res->value[0] = ru.ru_minflt - ru_start.ru_minflt;
+    res->value[1] = ru.ru_majflt - ru_start.ru_majflt;
+    res->value[2] = ru.ru_nvcsw - ru_start.ru_nvcsw;
+    res->value[3] = ru.ru_nivcsw - ru_start.ru_nivcsw;
+}
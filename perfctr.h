@@ -0,0 +1,27 @@
+/*
+ * perfctr.h - prototypes for the routines in perfctr.c that count
+ *     hardware events (instructions, cache and TLB misses, ...) while
+ *     a piece of code runs
+ */
+
+#define PERFCTR_MAX 8  /* most counters we ever open at once */
+
+/* The values of the open counters over one measurement */
+typedef struct {
+    int n;                          /* number of valid entries */
+    const char *name[PERFCTR_MAX];  /* short column name of each counter */
+    double value[PERFCTR_MAX];      /* event count of each counter */
+} perfctr_t;
+
+/*
+ * perfctr_init - Open the counters. Tries the hardware events first,
+ *     then the kernel's software events, and finally falls back to
+ *     getrusage(). Returns a string describing which set is in use.
+ */
+const char *perfctr_init(void);
+
+/* perfctr_start - Reset and start the counters */
+void perfctr_start(void);
+
+/* perfctr_stop - Stop the counters and store their values in *res */
+void perfctr_stop(perfctr_t *res);
@@ -0,0 +1,178 @@
+/*
+ * rep.c - Read, write and combine .rep trace files
+ *
+ * A trace file starts with four header lines (weight, number of ids,
+ * number of requests, ignore-ranges flag) followed by one request per
+ * line: "a <id> <size>", "r <id> <size>" or "f <id>". The driver and
+ * the trace tools all go through these routines, so they agree on the
+ * format.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rep.h"
+
+static char errbuf[1024];  /* holds the last message from rep_read */
+
+/*
+ * rep_read - Read the trace in path into *rep
+ */
+const char *rep_read(const char *path, rep_t *rep)
+{
+    FILE *fp;
+    char type[16];
+    int i, index;
+    unsigned long size = 0, last_size = 0;
+
+    memset(rep, 0, sizeof(*rep));
+    if ((fp = fopen(path, "r")) == NULL) {
+        snprintf(errbuf, sizeof(errbuf), "%s: could not open", path);
+        return errbuf;
+    }
+    if (fscanf(fp, "%d %d %d %d", &rep->weight, &rep->num_ids,
+               &rep->num_ops, &rep->ignore_ranges) != 4 ||
+        rep->num_ids < 0 || rep->num_ops < 0) {
+        fclose(fp);
+        snprintf(errbuf, sizeof(errbuf), "%s: bad header", path);
+        return errbuf;
+    }
+    if ((rep->ops = calloc(rep->num_ops + 1, sizeof(rep_op_t))) == NULL) {
+        fclose(fp);
+        snprintf(errbuf, sizeof(errbuf), "%s: out of memory", path);
+        return errbuf;
+    }
+
+    for (i = 0; i < rep->num_ops; i++) {
+        if (fscanf(fp, "%15s %d", type, &index) != 2)
+            break;
+        /* A few traces leave sizes out; like the original driver's
+           parser, we reuse the size of the previous request then */
+        size = 0;
+        if ((type[0] == 'a' || type[0] == 'r') &&
+            fscanf(fp, "%lu", &size) != 1)
+            size = last_size;
+        if (type[0] != 'f')
+            last_size = size;
+        if ((type[0] != 'a' && type[0] != 'r' && type[0] != 'f') ||
+            type[1] != '\0') {
+            snprintf(errbuf, sizeof(errbuf),
+                     "%s: bogus type character (%c) in request %d",
+                     path, type[0], i);
+            fclose(fp);
+            rep_free(rep);
+            return errbuf;
+        }
+        if (index >= rep->num_ids || (index < 0 && type[0] != 'f')) {
+            snprintf(errbuf, sizeof(errbuf),
+                     "%s: id %d of request %d is out of range",
+                     path, index, i);
+            fclose(fp);
+            rep_free(rep);
+            return errbuf;
+        }
+        rep->ops[i].type = type[0];
+        rep->ops[i].index = index;
+        rep->ops[i].size = size;
+    }
+    fclose(fp);
+
+    if (i < rep->num_ops) {
+        snprintf(errbuf, sizeof(errbuf), "%s: expected %d requests, found %d",
+                 path, rep->num_ops, i);
+        rep_free(rep);
+        return errbuf;
+    }
+    return NULL;
+}
+
+/*
+ * rep_write - Write the trace to fp in .rep format
+ */
+int rep_write(FILE *fp, const rep_t *rep)
+{
+    int i;
+    const rep_op_t *op;
+
+    fprintf(fp, "%d\n%d\n%d\n%d\n", rep->weight, rep->num_ids,
+            rep->num_ops, rep->ignore_ranges);
+    for (i = 0; i < rep->num_ops; i++) {
+        op = &rep->ops[i];
+        if (op->type == 'f')
+            fprintf(fp, "f %d\n", op->index);
+        else
+            fprintf(fp, "%c %d %zu\n", op->type, op->index, op->size);
+    }
+    return ferror(fp) ? -1 : 0;
+}
+
+/*
+ * rep_free - Free the requests of a trace
+ */
+void rep_free(rep_t *rep)
+{
+    free(rep->ops);
+    rep->ops = NULL;
+    rep->num_ops = 0;
+}
+
+/*
+ * rep_mix - Interleave n traces into one. At every step we take the
+ *     next request of the trace that is furthest behind its share of
+ *     the result, i.e. whose (done + 1/2) / num_ops is smallest, so
+ *     copies of one trace simply take turns.
+ */
+const char *rep_mix(rep_t *out, const rep_t *const *in, int n)
+{
+    int i, k, best;
+    int *pos, *base;
+    double t, best_t;
+    rep_op_t op;
+
+    memset(out, 0, sizeof(*out));
+    if (n <= 0)
+        return "nothing to mix";
+
+    pos = calloc(n, sizeof(int));
+    base = calloc(n, sizeof(int));
+    if (pos == NULL || base == NULL) {
+        free(pos);
+        free(base);
+        return "out of memory";
+    }
+
+    out->weight = in[0]->weight;
+    for (i = 0; i < n; i++) {
+        base[i] = out->num_ids;
+        out->num_ids += in[i]->num_ids;
+        out->num_ops += in[i]->num_ops;
+        out->ignore_ranges |= in[i]->ignore_ranges;
+    }
+    if ((out->ops = calloc(out->num_ops + 1, sizeof(rep_op_t))) == NULL) {
+        free(pos);
+        free(base);
+        return "out of memory";
+    }
+
+    for (k = 0; k < out->num_ops; k++) {
+        best = -1;
+        best_t = 0;
+        for (i = 0; i < n; i++) {
+            if (pos[i] == in[i]->num_ops)
+                continue;
+            t = (pos[i] + 0.5) / in[i]->num_ops;
+            if (best < 0 || t < best_t) {
+                best = i;
+                best_t = t;
+            }
+        }
+        op = in[best]->ops[pos[best]++];
+        if (op.index >= 0)
+            op.index += base[best];
+        out->ops[k] = op;
+    }
+
+    free(pos);
+    free(base);
+    return NULL;
+}
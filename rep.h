@@ -0,0 +1,42 @@
+/*
+ * rep.h - prototypes for the routines in rep.c that read, write and
+ *     combine .rep trace files
+ */
+#include <stdio.h>
+
+/* One request of a trace */
+typedef struct {
+    char type;     /* 'a' (malloc), 'r' (realloc) or 'f' (free) */
+    int index;     /* id of the block; -1 frees the null pointer */
+    size_t size;   /* payload size of an 'a' or 'r' request */
+} rep_op_t;
+
+/* A trace file: its four header lines and its requests */
+typedef struct {
+    int weight;
+    int num_ids;        /* ids are 0 .. num_ids-1 */
+    int num_ops;
+    int ignore_ranges;
+    rep_op_t *ops;
+} rep_t;
+
+/*
+ * rep_read - Read the trace in path into *rep. Returns NULL on success,
+ *     or a message saying what is wrong with the file.
+ */
+const char *rep_read(const char *path, rep_t *rep);
+
+/* rep_write - Write the trace to fp in .rep format; -1 on error */
+int rep_write(FILE *fp, const rep_t *rep);
+
+/* rep_free - Free the requests of a trace read or built by this module */
+void rep_free(rep_t *rep);
+
+/*
+ * rep_mix - Interleave the n traces in[] into *out. Each trace keeps
+ *     the order of its own requests and is spread evenly over the whole
+ *     of the result, so the traces keep their relative request rates.
+ *     The ids of in[i] are renumbered to follow those of in[i-1]; the
+ *     same trace may appear more than once. Returns NULL on success.
+ */
+const char *rep_mix(rep_t *out, const rep_t *const *in, int n);
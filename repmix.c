@@ -0,0 +1,126 @@
+/*
+ * repmix.c - Scale up and mix .rep traces
+ *
+ * Interleaves copies of one or more traces into a single trace with
+ * renumbered ids, e.g. to run a trace on a heap N times its usual size,
+ * or to have several programs share one heap:
+ *
+ *     unix> ./repmix -n 4 traces/perl.rep > perl-x4.rep
+ *     unix> ./repmix -o mix.rep traces/bash.rep traces/perl.rep:2 \
+ *               traces/firefox.rep
+ *
+ * Each trace is spread evenly over the result, so the traces keep the
+ * request rates they have relative to one another. A ":k" suffix on a
+ * file name asks for k copies of that trace instead of the -n count.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+
+#include "rep.h"
+
+static void usage(void)
+{
+    fprintf(stderr, "Usage: repmix [-h] [-n <copies>] [-w <weight>] "
+            "[-o <outfile>] <trace>[:<copies>] ...\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-h         Print this message.\n");
+    fprintf(stderr, "\t-n <n>     Use <n> copies of every trace without a :<copies> suffix (default 1).\n");
+    fprintf(stderr, "\t-o <file>  Write the result to <file> instead of stdout.\n");
+    fprintf(stderr, "\t-w <w>     Weight to put in the header (default: the first trace's).\n");
+}
+
+int main(int argc, char **argv)
+{
+    int c, i, k, n, ntraces = 0, total = 0;
+    int copies = 1, weight = -1;
+    char *outfile = NULL, *colon;
+    rep_t *reps, mixed;
+    const rep_t **in;
+    int *count;
+    const char *err;
+    FILE *fp = stdout;
+
+    while ((c = getopt(argc, argv, "hn:o:w:")) != EOF) {
+        switch (c) {
+        case 'n':
+            copies = atoi(optarg);
+            break;
+        case 'o':
+            outfile = optarg;
+            break;
+        case 'w':
+            weight = atoi(optarg);
+            break;
+        case 'h':
+            usage();
+            exit(0);
+        default:
+            usage();
+            exit(1);
+        }
+    }
+    ntraces = argc - optind;
+    if (ntraces <= 0 || copies <= 0) {
+        usage();
+        exit(1);
+    }
+
+    reps = calloc(ntraces, sizeof(rep_t));
+    count = calloc(ntraces, sizeof(int));
+    if (reps == NULL || count == NULL) {
+        fprintf(stderr, "repmix: out of memory\n");
+        exit(1);
+    }
+
+    /* Read each trace once, however many copies of it we use */
+    for (i = 0; i < ntraces; i++) {
+        char *name = argv[optind + i];
+
+        count[i] = copies;
+        if ((colon = strrchr(name, ':')) != NULL && colon[1] != '\0' &&
+            strspn(colon + 1, "0123456789") == strlen(colon + 1)) {
+            *colon = '\0';
+            count[i] = atoi(colon + 1);
+        }
+        if ((err = rep_read(name, &reps[i])) != NULL) {
+            fprintf(stderr, "repmix: %s\n", err);
+            exit(1);
+        }
+        total += count[i];
+    }
+
+    if ((in = calloc(total, sizeof(rep_t *))) == NULL) {
+        fprintf(stderr, "repmix: out of memory\n");
+        exit(1);
+    }
+    for (i = 0, n = 0; i < ntraces; i++)
+        for (k = 0; k < count[i]; k++)
+            in[n++] = &reps[i];
+
+    if ((err = rep_mix(&mixed, in, total)) != NULL) {
+        fprintf(stderr, "repmix: %s\n", err);
+        exit(1);
+    }
+    if (weight >= 0)
+        mixed.weight = weight;
+
+    if (outfile != NULL && (fp = fopen(outfile, "w")) == NULL) {
+        fprintf(stderr, "repmix: could not open %s\n", outfile);
+        exit(1);
+    }
+    if (rep_write(fp, &mixed) < 0 || (outfile != NULL && fclose(fp) != 0)) {
+        fprintf(stderr, "repmix: error writing the trace\n");
+        exit(1);
+    }
+
+    rep_free(&mixed);
+    for (i = 0; i < ntraces; i++)
+        rep_free(&reps[i]);
+    free(reps);
+    free(count);
+    free(in);
+    return 0;
+}
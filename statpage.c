@@ -0,0 +1,124 @@
+/*
+ * statpage.c - Publish the interposed mm package's counters in shared memory
+ *
+ * The page is refreshed from the allocator itself, every so many
+ * requests, with nothing but stores to memory: the object is created
+ * and mapped once, by statpage_init(), and unlinked at exit. A child
+ * made by fork() gets a page of its own, since it would otherwise
+ * write over its parent's.
+ */
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "mm.h"
+#include "statpage.h"
+
+#define STATPAGE_EVERY 1024     /* default requests between refreshes */
+
+long statpage_countdown = LONG_MAX;
+unsigned long statpage_ops[SP_NOPS];
+
+static statpage_t *page;
+static long every = STATPAGE_EVERY;
+static char name[32];
+
+/*
+ * statpage_unlink - Remove our page's name at exit
+ */
+static void statpage_unlink(void)
+{
+    if (page != NULL)
+        shm_unlink(name);
+}
+
+/*
+ * statpage_child - After fork(), drop the parent's page for one of our own
+ */
+static void statpage_child(void)
+{
+    if (page == NULL)
+        return;
+    munmap(page, sizeof(statpage_t));
+    page = NULL;
+    statpage_countdown = LONG_MAX;
+    memset(statpage_ops, 0, sizeof(statpage_ops));
+    statpage_init();
+}
+
+/*
+ * statpage_init - Create /mmstat.<pid> if MM_STATS is set
+ */
+void statpage_init(void)
+{
+    static int registered = 0;
+    const char *s = getenv("MM_STATS");
+    int fd;
+
+    if (page != NULL || s == NULL || *s == '\0')
+        return;
+    if ((s = getenv("MM_STATS_EVERY")) != NULL && atol(s) > 0)
+        every = atol(s);
+
+    snprintf(name, sizeof(name), STATPAGE_NAME, (int)getpid());
+    if ((fd = shm_open(name, O_RDWR | O_CREAT | O_TRUNC, 0644)) < 0)
+        return;
+    if (ftruncate(fd, sizeof(statpage_t)) < 0) {
+        close(fd);
+        shm_unlink(name);
+        return;
+    }
+    page = mmap(NULL, sizeof(statpage_t), PROT_READ | PROT_WRITE,
+                MAP_SHARED, fd, 0);
+    close(fd);
+    if (page == MAP_FAILED) {
+        page = NULL;
+        shm_unlink(name);
+        return;
+    }
+    if (!registered) {
+        atexit(statpage_unlink);
+        pthread_atfork(NULL, NULL, statpage_child);
+        registered = 1;
+    }
+
+    page->version = STATPAGE_VERSION;
+    page->size = sizeof(statpage_t);
+    page->pid = getpid();
+    statpage_publish();
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy(page->magic, STATPAGE_MAGIC, sizeof(STATPAGE_MAGIC));
+}
+
+/*
+ * statpage_publish - Write a fresh snapshot between two bumps of seq
+ */
+void statpage_publish(void)
+{
+    uint32_t seq;
+    int i;
+
+    if (page == NULL) {
+        statpage_countdown = LONG_MAX;
+        return;
+    }
+    statpage_countdown = every;
+
+    seq = page->seq;
+    __atomic_store_n(&page->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    mm_stats(&page->stats);
+    for (i = 0; i < SP_NOPS; i++)
+        page->ops[i] = statpage_ops[i];
+    page->frag = page->stats.free_bytes == 0 ? 0 :
+        1 - (double)page->stats.largest_free / page->stats.free_bytes;
+    page->publishes++;
+
+    __atomic_store_n(&page->seq, seq + 2, __ATOMIC_RELEASE);
+}
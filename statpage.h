@@ -0,0 +1,50 @@
+/*
+ * statpage.h - Live counters of the interposed mm package, in shared memory
+ *
+ * With MM_STATS set in its environment, a process running on libmm.so
+ * publishes a statpage_t in the POSIX shared memory object
+ * /mmstat.<pid>, refreshed every MM_STATS_EVERY requests (1024 if
+ * unset), and "mmstat <pid>" prints it as it changes. The page has a
+ * single writer, the allocator, which never waits for readers: seq is
+ * odd while the page is being written, and a reader that sees it odd,
+ * or changed by the time it has copied the page, tries again.
+ */
+#include <stdint.h>
+
+/* Needs mm_stats_t: include mm.h first */
+
+#define STATPAGE_MAGIC   "MMSTAT"
+#define STATPAGE_VERSION 1
+#define STATPAGE_NAME    "/mmstat.%d"  /* and the pid */
+
+/* Request types */
+enum { SP_MALLOC, SP_FREE, SP_REALLOC, SP_NOPS };
+
+typedef struct {
+    char magic[8];              /* STATPAGE_MAGIC, once the page is valid */
+    uint32_t version;           /* STATPAGE_VERSION */
+    uint32_t size;              /* sizeof(statpage_t) */
+    uint32_t seq;               /* odd while the page is being written */
+    int32_t pid;                /* the process publishing it */
+    uint64_t publishes;         /* times the page has been written */
+    uint64_t ops[SP_NOPS];      /* requests served, by type */
+    double frag;                /* 1 - largest free block / free bytes */
+    mm_stats_t stats;           /* mm_stats() at the last refresh */
+} statpage_t;
+
+/* Requests to go before the next refresh; huge while it is off */
+extern long statpage_countdown;
+extern unsigned long statpage_ops[SP_NOPS];
+
+/* Count a request of type op, and refresh the page when it is due */
+#define STATPAGE_COUNT(op) do {                  \
+        statpage_ops[op]++;                      \
+        if (--statpage_countdown < 0)            \
+            statpage_publish();                  \
+    } while (0)
+
+/* Read the environment and, if asked to, create the page */
+extern void statpage_init(void);
+
+/* Write the counters to the page now */
+extern void statpage_publish(void);
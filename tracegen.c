@@ -0,0 +1,392 @@
+/*
+ * tracegen.c - Generate synthetic .rep traces
+ *
+ * A trace is made of one or more phases. Each phase issues a number of
+ * requests drawn from its own distributions:
+ *
+ *   -s <dist>     request sizes in bytes
+ *   -l <dist>     lifetimes in requests; a block is freed once it has
+ *                 lived that long (fixed:0 means it lives until the end)
+ *   -L <bytes>    live-set target: while the payload bytes in use are at
+ *                 or above it, the block due soonest is freed early
+ *   -r <p>:<f>    with probability p a request reallocs a random live
+ *                 block to f times its size (f < 1 shrinks it)
+ *   -n <n>        number of requests in the phase
+ *
+ * and -p starts a new phase, which inherits the settings of the phase
+ * before it. Blocks live on across phases. A distribution is one of
+ *
+ *   fixed:N  uniform:MIN:MAX  exp:MEAN  power:MIN:MAX:ALPHA
+ *   bimodal:A:B:P  (A with probability P, otherwise B)
+ *   empirical:FILE (lines of "value weight")
+ *
+ * For example, to hammer the 4096-byte class boundary while a set of
+ * small long-lived blocks fragments the heap:
+ *
+ *   unix> ./tracegen -S 1 -n 20000 -s power:8:256:1.2 -l exp:5000 \
+ *             -p -n 50000 -s uniform:4000:4200 -l exp:50 -L 1000000
+ *
+ * The same seed (-S) always gives the same trace.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <limits.h>
+#include <unistd.h>
+#include <getopt.h>
+
+#include "rep.h"
+
+#define MAXPHASES 64
+
+/* A distribution of sizes or lifetimes */
+typedef struct {
+    enum { D_FIXED, D_UNIFORM, D_EXP, D_POWER, D_BIMODAL, D_EMPIRICAL } kind;
+    double a, b, c;     /* parameters, in the order they are written */
+    int n;              /* for D_EMPIRICAL: number of values ... */
+    double *value;      /* ... the values ... */
+    double *cum;        /* ... and their cumulative weights */
+} dist_t;
+
+/* The settings of one phase */
+typedef struct {
+    int num_ops;
+    dist_t size;
+    dist_t life;
+    size_t live_target;     /* 0 means no target */
+    double realloc_p;
+    double realloc_factor;
+} phase_t;
+
+/* A live block, due to be freed at request number due */
+typedef struct {
+    long due;
+    int id;
+} due_t;
+
+static unsigned long long rng_state = 88172645463325252ULL;
+
+/*
+ * rng_next - xorshift64* generator; returns a double in [0, 1)
+ */
+static double rng_next(void)
+{
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return ((rng_state * 2685821657736338717ULL) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static void die(const char *msg, const char *arg)
+{
+    fprintf(stderr, "tracegen: %s%s\n", msg, arg);
+    exit(1);
+}
+
+/*
+ * read_empirical - Load the "value weight" lines of file into d
+ */
+static void read_empirical(dist_t *d, const char *file)
+{
+    FILE *fp;
+    double v, w, sum = 0;
+    int max = 0;
+
+    if ((fp = fopen(file, "r")) == NULL)
+        die("could not open ", file);
+    d->n = 0;
+    while (fscanf(fp, "%lf %lf", &v, &w) == 2) {
+        if (d->n == max) {
+            max = max ? 2 * max : 64;
+            d->value = realloc(d->value, max * sizeof(double));
+            d->cum = realloc(d->cum, max * sizeof(double));
+            if (d->value == NULL || d->cum == NULL)
+                die("out of memory reading ", file);
+        }
+        sum += w;
+        d->value[d->n] = v;
+        d->cum[d->n] = sum;
+        d->n++;
+    }
+    fclose(fp);
+    if (d->n == 0 || sum <= 0)
+        die("no values with positive weight in ", file);
+}
+
+/*
+ * parse_dist - Parse a distribution spec like "uniform:16:64"
+ */
+static void parse_dist(dist_t *d, const char *spec)
+{
+    int n;
+
+    memset(d, 0, sizeof(*d));
+    if (strncmp(spec, "empirical:", 10) == 0) {
+        d->kind = D_EMPIRICAL;
+        read_empirical(d, spec + 10);
+        return;
+    }
+    if (sscanf(spec, "fixed:%lf%n", &d->a, &n) == 1 && spec[n] == '\0')
+        d->kind = D_FIXED;
+    else if (sscanf(spec, "uniform:%lf:%lf%n", &d->a, &d->b, &n) == 2 &&
+             spec[n] == '\0' && d->a <= d->b)
+        d->kind = D_UNIFORM;
+    else if (sscanf(spec, "exp:%lf%n", &d->a, &n) == 1 && spec[n] == '\0' &&
+             d->a > 0)
+        d->kind = D_EXP;
+    else if (sscanf(spec, "power:%lf:%lf:%lf%n", &d->a, &d->b, &d->c, &n) == 3
+             && spec[n] == '\0' && d->a > 0 && d->a <= d->b && d->c > 0)
+        d->kind = D_POWER;
+    else if (sscanf(spec, "bimodal:%lf:%lf:%lf%n", &d->a, &d->b, &d->c, &n) == 3
+             && spec[n] == '\0' && d->c >= 0 && d->c <= 1)
+        d->kind = D_BIMODAL;
+    else
+        die("bad distribution: ", spec);
+}
+
+/*
+ * sample - Draw a value from the distribution
+ */
+static double sample(const dist_t *d)
+{
+    double u = rng_next();
+    int lo, hi, mid;
+
+    switch (d->kind) {
+    case D_FIXED:
+        return d->a;
+    case D_UNIFORM:
+        return d->a + u * (d->b - d->a + 1);
+    case D_EXP:
+        return -d->a * log(1.0 - u);
+    case D_POWER:
+        /* bounded Pareto on [a, b] with exponent c */
+        return d->a * pow(1.0 - u * (1.0 - pow(d->a / d->b, d->c)),
+                          -1.0 / d->c);
+    case D_BIMODAL:
+        return (u < d->c) ? d->a : d->b;
+    case D_EMPIRICAL:
+        u *= d->cum[d->n - 1];
+        lo = 0;
+        hi = d->n - 1;
+        while (lo < hi) {
+            mid = (lo + hi) / 2;
+            if (d->cum[mid] > u)
+                hi = mid;
+            else
+                lo = mid + 1;
+        }
+        return d->value[lo];
+    }
+    return 0;
+}
+
+/* The live blocks, ordered by due time in a binary min-heap */
+static due_t *heap;
+static int heap_n;
+
+static void heap_push(long due, int id)
+{
+    int i = heap_n++;
+    due_t t;
+
+    heap[i].due = due;
+    heap[i].id = id;
+    while (i > 0 && heap[(i - 1) / 2].due > heap[i].due) {
+        t = heap[i];
+        heap[i] = heap[(i - 1) / 2];
+        heap[(i - 1) / 2] = t;
+        i = (i - 1) / 2;
+    }
+}
+
+static int heap_pop(void)
+{
+    int id = heap[0].id, i = 0, c;
+    due_t t;
+
+    heap[0] = heap[--heap_n];
+    while ((c = 2 * i + 1) < heap_n) {
+        if (c + 1 < heap_n && heap[c + 1].due < heap[c].due)
+            c++;
+        if (heap[i].due <= heap[c].due)
+            break;
+        t = heap[i];
+        heap[i] = heap[c];
+        heap[c] = t;
+        i = c;
+    }
+    return id;
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "Usage: tracegen [-h] [-S <seed>] [-w <weight>] [-k] "
+            "[-o <outfile>] <phase> [-p <phase>] ...\n");
+    fprintf(stderr, "where a phase is [-n <requests>] [-s <dist>] "
+            "[-l <dist>] [-L <bytes>] [-r <p>:<factor>]\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-h         Print this message.\n");
+    fprintf(stderr, "\t-k         Keep the blocks still live at the end (default: free them).\n");
+    fprintf(stderr, "\t-o <file>  Write the trace to <file> instead of stdout.\n");
+    fprintf(stderr, "\t-p         Start a new phase.\n");
+    fprintf(stderr, "\t-S <seed>  Seed for the random number generator.\n");
+    fprintf(stderr, "\t-w <w>     Weight to put in the header (default 1).\n");
+    fprintf(stderr, "Distributions: fixed:N uniform:MIN:MAX exp:MEAN "
+            "power:MIN:MAX:ALPHA bimodal:A:B:P empirical:FILE\n");
+}
+
+int main(int argc, char **argv)
+{
+    phase_t phases[MAXPHASES];
+    int nphases = 1;
+    phase_t *ph = &phases[0];
+    int c, i, k, id, pos, keep = 0, weight = 1;
+    int max_ops, max_ids;
+    long now;
+    size_t live = 0, size;
+    double life;
+    char *outfile = NULL;
+    FILE *fp = stdout;
+    rep_t rep;
+    size_t *sizes;     /* payload size of each id, 0 once freed */
+    int *live_ids;     /* the live ids, in no order ... */
+    int *live_pos;     /* ... and where each id is in live_ids */
+    int nlive = 0;
+
+    memset(ph, 0, sizeof(*ph));
+    ph->num_ops = 10000;
+    parse_dist(&ph->size, "power:8:4096:1");
+    parse_dist(&ph->life, "exp:1000");
+    ph->realloc_factor = 1.5;
+
+    while ((c = getopt(argc, argv, "hkn:o:pr:s:l:w:L:S:")) != EOF) {
+        switch (c) {
+        case 'k':
+            keep = 1;
+            break;
+        case 'n':
+            ph->num_ops = atoi(optarg);
+            break;
+        case 'o':
+            outfile = optarg;
+            break;
+        case 'p':
+            if (nphases == MAXPHASES)
+                die("too many phases", "");
+            phases[nphases] = *ph;
+            ph = &phases[nphases++];
+            break;
+        case 'r':
+            if (sscanf(optarg, "%lf:%lf", &ph->realloc_p,
+                       &ph->realloc_factor) != 2 ||
+                ph->realloc_p < 0 || ph->realloc_p > 1 ||
+                ph->realloc_factor <= 0)
+                die("bad realloc pattern: ", optarg);
+            break;
+        case 's':
+            parse_dist(&ph->size, optarg);
+            break;
+        case 'l':
+            parse_dist(&ph->life, optarg);
+            break;
+        case 'w':
+            weight = atoi(optarg);
+            break;
+        case 'L':
+            ph->live_target = strtoul(optarg, NULL, 0);
+            break;
+        case 'S':
+            rng_state = strtoull(optarg, NULL, 0) * 0x9E3779B97F4A7C15ULL + 1;
+            break;
+        case 'h':
+            usage();
+            exit(0);
+        default:
+            usage();
+            exit(1);
+        }
+    }
+
+    /* Every request allocates at most one id, and every id is freed
+       at most once more at the end */
+    max_ops = 0;
+    for (i = 0; i < nphases; i++)
+        max_ops += phases[i].num_ops;
+    max_ids = max_ops;
+
+    memset(&rep, 0, sizeof(rep));
+    rep.weight = weight;
+    rep.ops = calloc(2 * (size_t)max_ops + 1, sizeof(rep_op_t));
+    sizes = calloc(max_ids + 1, sizeof(size_t));
+    live_ids = calloc(max_ids + 1, sizeof(int));
+    live_pos = calloc(max_ids + 1, sizeof(int));
+    heap = calloc(max_ids + 1, sizeof(due_t));
+    if (rep.ops == NULL || sizes == NULL || live_ids == NULL ||
+        live_pos == NULL || heap == NULL)
+        die("out of memory", "");
+
+    now = 0;
+    for (i = 0; i < nphases; i++) {
+        ph = &phases[i];
+        for (k = 0; k < ph->num_ops; k++, now++) {
+            rep_op_t *op = &rep.ops[rep.num_ops++];
+
+            if (heap_n > 0 && (heap[0].due <= now ||
+                               (ph->live_target > 0 &&
+                                live >= ph->live_target))) {
+                /* free the block that is due, or due soonest */
+                id = heap_pop();
+                op->type = 'f';
+            } else if (nlive > 0 && rng_next() < ph->realloc_p) {
+                id = live_ids[(int)(rng_next() * nlive)];
+                size = (size_t)(sizes[id] * ph->realloc_factor + 0.5);
+                op->type = 'r';
+                op->index = id;
+                op->size = size > 0 ? size : 1;
+                live += op->size - sizes[id];
+                sizes[id] = op->size;
+                continue;
+            } else {
+                /* allocate a new block */
+                id = rep.num_ids++;
+                size = (size_t)sample(&ph->size);
+                op->type = 'a';
+                op->index = id;
+                op->size = sizes[id] = size > 0 ? size : 1;
+                live += sizes[id];
+                live_pos[id] = nlive;
+                live_ids[nlive++] = id;
+                if (ph->life.kind == D_FIXED && ph->life.a <= 0) {
+                    heap_push(LONG_MAX, id);
+                } else {
+                    life = sample(&ph->life) + 0.5;
+                    heap_push(now + (life >= 1 ? (long)life : 1), id);
+                }
+                continue;
+            }
+
+            /* the request frees block id */
+            op->index = id;
+            live -= sizes[id];
+            sizes[id] = 0;
+            pos = live_pos[id];
+            live_ids[pos] = live_ids[--nlive];
+            live_pos[live_ids[pos]] = pos;
+        }
+    }
+
+    /* Free whatever is left, unless asked to keep it */
+    for (k = 0; !keep && k < nlive; k++) {
+        rep_op_t *op = &rep.ops[rep.num_ops++];
+        op->type = 'f';
+        op->index = live_ids[k];
+    }
+
+    if (outfile != NULL && (fp = fopen(outfile, "w")) == NULL)
+        die("could not open ", outfile);
+    if (rep_write(fp, &rep) < 0 || (outfile != NULL && fclose(fp) != 0))
+        die("error writing the trace", "");
+    return 0;
+}
@@ -0,0 +1,393 @@
+/*
+ * tracestat.c - Characterize .rep traces
+ *
+ * For each trace on the command line, prints a JSON object with
+ *
+ *   mix        number of malloc, free and realloc requests
+ *   classes    requests and bytes per size class of mm.c, using the
+ *              block size mm.c would pick for the request
+ *   sizes      request sizes by power of two, plus percentiles
+ *   lifetimes  how many requests blocks live, by power of two
+ *   realloc    realloc chains (reallocs of one block between its
+ *              malloc and free) and the growth factors they use
+ *   peak       the most payload bytes and blocks live at once
+ *   bound      lower bounds on the heap any allocator needs: the peak
+ *              payload, the peak with every payload rounded to 8
+ *              bytes, and the peak of mm.c's block sizes (headers
+ *              and footers included)
+ *   windows    the request mix and live bytes over time
+ *
+ * With several traces the objects are put in an array. -E writes the
+ * request sizes as "size count" lines, which tracegen takes as an
+ * empirical distribution.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <getopt.h>
+
+#include "rep.h"
+
+#define MAXCLASSES 32
+#define LOG_BUCKETS 40
+#define ALIGNMENT 8
+#define ALIGN(size) (((size) + (ALIGNMENT-1)) / ALIGNMENT * ALIGNMENT)
+
+/* The upper limits of mm.c's size classes; the last class is unbounded */
+static size_t class_limit[MAXCLASSES] = {
+    28, 64, 96, 128, 192, 256, 384, 512, 768, 1024, 1536, 2048, 4096
+};
+static int nclasses = 14;
+
+static int nwindows = 10;
+
+/* The block size mm.c's malloc picks for a request of size bytes */
+static size_t block_size(size_t size)
+{
+    if (size <= 8)
+        return 16;
+    return 8 * ((size + 8 + 7) / 8);
+}
+
+static int size_class(size_t asize)
+{
+    int c;
+
+    for (c = 0; c < nclasses - 1; c++)
+        if (asize <= class_limit[c])
+            return c;
+    return nclasses - 1;
+}
+
+/* Index of the power-of-two bucket [2^k, 2^(k+1)) holding v (0 -> 0) */
+static int log_bucket(unsigned long long v)
+{
+    int k = 0;
+
+    while (v > 1 && k < LOG_BUCKETS - 1) {
+        v >>= 1;
+        k++;
+    }
+    return k;
+}
+
+static int cmp_size(const void *a, const void *b)
+{
+    size_t x = *(const size_t *)a, y = *(const size_t *)b;
+    return (x > y) - (x < y);
+}
+
+/* Print a histogram of power-of-two buckets as a JSON array */
+static void print_log_hist(const char *name, const unsigned long *hist)
+{
+    int k, last = -1, first = 1;
+
+    for (k = 0; k < LOG_BUCKETS; k++)
+        if (hist[k] > 0)
+            last = k;
+    printf("  \"%s\": [", name);
+    for (k = 0; k <= last; k++) {
+        if (hist[k] == 0)
+            continue;
+        printf("%s{\"min\": %llu, \"count\": %lu}", first ? "" : ", ",
+               k == 0 ? 0ULL : 1ULL << k, hist[k]);
+        first = 0;
+    }
+    printf("],\n");
+}
+
+/*
+ * analyze - Print the JSON object for one trace; write its request
+ *     sizes to emp if that isn't NULL
+ */
+static void analyze(const char *path, const rep_t *rep, FILE *emp)
+{
+    int i, c, w, id;
+    unsigned long nmalloc = 0, nfree = 0, nrealloc = 0;
+    unsigned long class_req[MAXCLASSES] = {0};
+    unsigned long long class_bytes[MAXCLASSES] = {0};
+    unsigned long size_hist[LOG_BUCKETS] = {0};
+    unsigned long life_hist[LOG_BUCKETS] = {0};
+    unsigned long chain_hist[LOG_BUCKETS] = {0};
+    unsigned long growth[6] = {0};  /* <0.5, <1, =1, <1.5, <2, >=2 */
+    static const char *growth_name[6] = {
+        "<0.5", "<1", "1", "<1.5", "<2", ">=2"
+    };
+    unsigned long never_freed = 0, chains = 0, max_chain = 0;
+    unsigned long nlive = 0, peak_blocks = 0;
+    unsigned long long live = 0, aligned = 0, blocks = 0;
+    unsigned long long peak_live = 0, peak_aligned = 0, peak_blocks_bytes = 0;
+    double log_growth = 0;
+    unsigned long ngrowth = 0;
+    int peak_op = 0;
+    size_t *sizes, *all_sizes;
+    int *born, *nchain;
+    unsigned long nsizes = 0;
+    unsigned long (*win)[3];
+    unsigned long long *win_live;
+    size_t old;
+    double g;
+
+    sizes = calloc(rep->num_ids + 1, sizeof(size_t));
+    born = calloc(rep->num_ids + 1, sizeof(int));
+    nchain = calloc(rep->num_ids + 1, sizeof(int));
+    all_sizes = calloc(rep->num_ops + 1, sizeof(size_t));
+    win = calloc(nwindows, sizeof(*win));
+    win_live = calloc(nwindows, sizeof(*win_live));
+    if (sizes == NULL || born == NULL ||
+        nchain == NULL || all_sizes == NULL || win == NULL ||
+        win_live == NULL) {
+        fprintf(stderr, "tracestat: out of memory\n");
+        exit(1);
+    }
+    for (id = 0; id < rep->num_ids; id++)
+        born[id] = -1;
+
+    for (i = 0; i < rep->num_ops; i++) {
+        const rep_op_t *op = &rep->ops[i];
+
+        id = op->index;
+        w = (int)((long long)i * nwindows / rep->num_ops);
+        old = (id >= 0) ? sizes[id] : 0;
+
+        if (op->type == 'a' || (op->type == 'r' && op->size > 0)) {
+            if (op->type == 'a') {
+                nmalloc++;
+                win[w][0]++;
+            } else {
+                nrealloc++;
+                win[w][2]++;
+            }
+            c = size_class(block_size(op->size));
+            class_req[c]++;
+            class_bytes[c] += op->size;
+            size_hist[log_bucket(op->size)]++;
+            all_sizes[nsizes++] = op->size;
+
+            if (op->type == 'r' && born[id] >= 0) {
+                nchain[id]++;
+                if (old > 0) {
+                    g = (double)op->size / old;
+                    growth[g < 0.5 ? 0 : g < 1 ? 1 : g == 1 ? 2 :
+                           g < 1.5 ? 3 : g < 2 ? 4 : 5]++;
+                    log_growth += (g > 0) ? log(g) : 0;
+                    ngrowth++;
+                }
+            } else {
+                /* a new block (or a realloc of one never allocated) */
+                born[id] = i;
+                nchain[id] = 0;
+                nlive++;
+            }
+            live += op->size - old;
+            aligned += ALIGN(op->size) - ALIGN(old);
+            blocks += block_size(op->size) - (old ? block_size(old) : 0);
+            sizes[id] = op->size;
+        } else {
+            /* free, or realloc to 0 */
+            if (op->type == 'f') {
+                nfree++;
+                win[w][1]++;
+            } else {
+                nrealloc++;
+                win[w][2]++;
+            }
+            if (id >= 0 && born[id] >= 0) {
+                life_hist[log_bucket(i - born[id])]++;
+                if (nchain[id] > 0) {
+                    chains++;
+                    chain_hist[log_bucket(nchain[id])]++;
+                    if ((unsigned long)nchain[id] > max_chain)
+                        max_chain = nchain[id];
+                }
+                live -= old;
+                aligned -= ALIGN(old);
+                blocks -= old ? block_size(old) : 0;
+                sizes[id] = 0;
+                born[id] = -1;
+                nlive--;
+            }
+        }
+
+        if (live > peak_live) {
+            peak_live = live;
+            peak_op = i;
+        }
+        if (nlive > peak_blocks)
+            peak_blocks = nlive;
+        if (aligned > peak_aligned)
+            peak_aligned = aligned;
+        if (blocks > peak_blocks_bytes)
+            peak_blocks_bytes = blocks;
+        win_live[w] = live;
+    }
+
+    /* Realloc chains of the blocks never freed end with the trace */
+    for (id = 0; id < rep->num_ids; id++) {
+        if (born[id] < 0)
+            continue;
+        never_freed++;
+        if (nchain[id] > 0) {
+            chains++;
+            chain_hist[log_bucket(nchain[id])]++;
+            if ((unsigned long)nchain[id] > max_chain)
+                max_chain = nchain[id];
+        }
+    }
+
+    qsort(all_sizes, nsizes, sizeof(size_t), cmp_size);
+
+    printf("{\n");
+    printf("  \"trace\": \"%s\",\n", path);
+    printf("  \"ops\": %d,\n", rep->num_ops);
+    printf("  \"ids\": %d,\n", rep->num_ids);
+    printf("  \"mix\": {\"malloc\": %lu, \"free\": %lu, \"realloc\": %lu},\n",
+           nmalloc, nfree, nrealloc);
+
+    printf("  \"classes\": [");
+    for (c = 0; c < nclasses; c++) {
+        printf("%s{\"max\": ", c ? ", " : "");
+        if (c < nclasses - 1)
+            printf("%zu", class_limit[c]);
+        else
+            printf("null");
+        printf(", \"requests\": %lu, \"bytes\": %llu}",
+               class_req[c], class_bytes[c]);
+    }
+    printf("],\n");
+
+    print_log_hist("sizes", size_hist);
+    if (nsizes > 0)
+        printf("  \"size_percentiles\": {\"p50\": %zu, \"p90\": %zu, "
+               "\"p99\": %zu, \"max\": %zu},\n",
+               all_sizes[nsizes / 2], all_sizes[nsizes * 9 / 10],
+               all_sizes[nsizes * 99 / 100], all_sizes[nsizes - 1]);
+
+    print_log_hist("lifetimes", life_hist);
+    printf("  \"never_freed\": %lu,\n", never_freed);
+
+    printf("  \"realloc\": {\"chains\": %lu, \"max_chain\": %lu, ",
+           chains, max_chain);
+    printf("\"mean_growth\": %.4f, \"growth\": {",
+           ngrowth ? exp(log_growth / ngrowth) : 0.0);
+    for (c = 0; c < 6; c++)
+        printf("%s\"%s\": %lu", c ? ", " : "", growth_name[c], growth[c]);
+    printf("}},\n");
+    print_log_hist("chain_lengths", chain_hist);
+
+    printf("  \"peak\": {\"bytes\": %llu, \"blocks\": %lu, \"op\": %d},\n",
+           peak_live, peak_blocks, peak_op);
+    printf("  \"bound\": {\"payload\": %llu, \"aligned\": %llu, "
+           "\"mm_blocks\": %llu},\n",
+           peak_live, peak_aligned, peak_blocks_bytes);
+
+    printf("  \"windows\": [");
+    for (w = 0; w < nwindows; w++) {
+        printf("%s\n    {\"start\": %lld, \"malloc\": %lu, \"free\": %lu, "
+               "\"realloc\": %lu, \"live_bytes\": %llu}", w ? "," : "",
+               (long long)rep->num_ops * w / nwindows,
+               win[w][0], win[w][1], win[w][2], win_live[w]);
+    }
+    printf("\n  ]\n}");
+
+    /* The sizes as an empirical distribution for tracegen */
+    if (emp != NULL) {
+        unsigned long k, run;
+
+        for (k = 0; k < nsizes; k += run) {
+            for (run = 1; k + run < nsizes &&
+                     all_sizes[k + run] == all_sizes[k]; run++)
+                ;
+            fprintf(emp, "%zu %lu\n", all_sizes[k], run);
+        }
+    }
+
+    free(sizes);
+    free(born);
+    free(nchain);
+    free(all_sizes);
+    free(win);
+    free(win_live);
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "Usage: tracestat [-h] [-c <limits>] [-w <n>] "
+            "[-E <file>] <trace> ...\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-c <limits> Comma-separated upper limits of the size classes\n");
+    fprintf(stderr, "\t            (default: mm.c's 28,64,96,...,4096).\n");
+    fprintf(stderr, "\t-E <file>   Write the request sizes of all traces to <file>\n");
+    fprintf(stderr, "\t            as an empirical distribution for tracegen.\n");
+    fprintf(stderr, "\t-h          Print this message.\n");
+    fprintf(stderr, "\t-w <n>      Split each trace into <n> windows (default 10).\n");
+}
+
+int main(int argc, char **argv)
+{
+    int c, i, ntraces;
+    char *s, *end;
+    const char *err;
+    FILE *emp = NULL;
+    rep_t rep;
+
+    while ((c = getopt(argc, argv, "hc:w:E:")) != EOF) {
+        switch (c) {
+        case 'c':
+            nclasses = 0;
+            for (s = optarg; *s != '\0' && nclasses < MAXCLASSES - 1; s = end) {
+                class_limit[nclasses++] = strtoul(s, &end, 0);
+                if (end == s) {
+                    fprintf(stderr, "tracestat: bad class limits %s\n", optarg);
+                    exit(1);
+                }
+                if (*end == ',')
+                    end++;
+            }
+            nclasses++;     /* the unbounded class at the end */
+            break;
+        case 'w':
+            nwindows = atoi(optarg);
+            if (nwindows < 1)
+                nwindows = 1;
+            break;
+        case 'E':
+            if ((emp = fopen(optarg, "w")) == NULL) {
+                fprintf(stderr, "tracestat: could not open %s\n", optarg);
+                exit(1);
+            }
+            break;
+        case 'h':
+            usage();
+            exit(0);
+        default:
+            usage();
+            exit(1);
+        }
+    }
+    ntraces = argc - optind;
+    if (ntraces <= 0) {
+        usage();
+        exit(1);
+    }
+
+    if (ntraces > 1)
+        printf("[");
+    for (i = 0; i < ntraces; i++) {
+        if ((err = rep_read(argv[optind + i], &rep)) != NULL) {
+            fprintf(stderr, "tracestat: %s\n", err);
+            exit(1);
+        }
+        if (i > 0)
+            printf(",\n");
+        analyze(argv[optind + i], &rep, emp);
+        rep_free(&rep);
+    }
+    printf(ntraces > 1 ? "]\n" : "\n");
+
+    if (emp != NULL)
+        fclose(emp);
+    return 0;
+}